@@ -22,7 +22,19 @@
 
 #include "aatree.h"
 
-static const aa_node_t
+/* Links to itself, level 0 */
+#ifdef AA_COMPACT_NODE
+const aa_node_t
+aa_nil_node =
+{
+    {
+        (uintptr_t) &aa_nil_node, 
+        (uintptr_t) &aa_nil_node 
+    },
+    0
+};
+#else
+const aa_node_t
 aa_nil_node =
 {
     {
@@ -32,6 +44,7 @@ aa_nil_node =
     0,
     0
 };
+#endif
 
 static aa_node_t *AA_NIL = (aa_node_t *) &aa_nil_node;
 
@@ -39,6 +52,68 @@ static aa_node_t *AA_NIL = (aa_node_t *) &aa_nil_node;
  *                          STATIC FUNCTIONS                              *
  **************************************************************************/
 
+/* Setters for both node layouts; see aa_child() and aa_lvl() */
+static inline void
+aa_set_child (aa_node_t  *n,
+              int         dir,
+              aa_node_t  *child)
+{
+#ifdef AA_COMPACT_NODE
+    n->aa_lnk [dir] = (uintptr_t) child | (n->aa_lnk [dir] & AA_LVL_MASK);
+#else
+#ifdef AA_THREADED
+    /* An empty right link keeps its thread; see aa_set_right() */
+    if ((dir == RIGHT) && (child == AA_NIL))
+    {
+        assert (aa_threaded (n));
+        return;
+    }
+#endif
+    n->aa_link [dir] = child;
+#endif
+}
+
+/*
+ * Set n's right link; if child is AA_NIL, thread it to succ, n's in-order
+ * successor, instead. Used wherever a right link may become empty.
+ */
+static inline void
+aa_set_right (aa_node_t  *n,
+              aa_node_t  *child,
+              aa_node_t  *succ)
+{
+#ifdef AA_THREADED
+    if (child == AA_NIL)
+    {
+        n->aa_link [RIGHT] = (aa_node_t *) ((uintptr_t) succ | AA_THREAD_TAG);
+        return;
+    }
+#endif
+    aa_set_child (n, RIGHT, child);
+}
+
+/* Successor of n, which must have no right child (unknown unthreaded) */
+#ifdef AA_THREADED
+#define aa_thread(n)    ((aa_node_t *) ((uintptr_t) (n)->aa_link[RIGHT] &     \
+                                        ~AA_THREAD_TAG))
+#else
+#define aa_thread(n)    AA_NIL
+#endif
+
+static inline void
+aa_set_lvl (aa_node_t  *n,
+            int         lvl)
+{
+#ifdef AA_COMPACT_NODE
+    n->aa_lnk [LEFT]  = (n->aa_lnk [LEFT] & ~AA_LVL_MASK) |
+                        ((uintptr_t) lvl & AA_LVL_MASK);
+    n->aa_lnk [RIGHT] = (n->aa_lnk [RIGHT] & ~AA_LVL_MASK) |
+                        (((uintptr_t) lvl >> 3) & AA_LVL_MASK);
+#else
+    n->aa_level = lvl;
+#endif
+}
+
 static inline void
 aan_new (aa_node_t **pn, 
          uintptr_t   data, 
@@ -49,10 +124,10 @@ aan_new (aa_node_t **pn,
     n = calloc (1, sizeof(*n));
     if (n)
     {
-        n->aa_level = lvl;
         n->aa_data  = data;
-        LLINK(n)    = AA_NIL;
-        RLINK(n)    = AA_NIL;
+        aa_set_child (n, LEFT,  AA_NIL);
+        aa_set_right (n, AA_NIL, AA_NIL);
+        aa_set_lvl   (n, lvl);
     }
 
     *pn = n;
@@ -64,96 +139,160 @@ aan_delete (aa_node_t **pn)
     if (!pn || !*pn)
         return;
     free(*pn);
-    pn = NULL;
+    *pn = NULL;
 }
 
+#ifdef AA_AUGMENT
+#define AA_MON(tree)    ((tree)->aat_mon)
+#else
+#define AA_MON(tree)    NULL
+#endif
+
+/* Recompute n's aggregate from its children's; nothing without a monoid */
 static inline void
-skew (aa_node_t **rootp)
+aa_fix (aa_node_t          *n,
+        const aa_monoid_t  *mon)
+{
+#ifdef AA_AUGMENT
+    uintptr_t agg;
+
+    if (mon == NULL)
+        return;
+    agg = (*mon->am_value) ((void *) n->aa_data);
+    if (LLINK(n) != AA_NIL)
+        agg = (*mon->am_combine) (LLINK(n)->aa_agg, agg);
+    if (RLINK(n) != AA_NIL)
+        agg = (*mon->am_combine) (agg, RLINK(n)->aa_agg);
+    n->aa_agg = agg;
+#else
+    (void) n;
+    (void) mon;
+#endif
+}
+
+/* 
+ * Both return the new root of the subtree; neither writes to AA_NIL. The
+ * two nodes rotated get their aggregates recomputed, lower one first.
+ */
+static inline aa_node_t*
+skew (aa_node_t          *root,
+      const aa_monoid_t  *mon)
 {
     aa_node_t *save;
 
-    if ((LLINK(*rootp)->aa_level == (*rootp)->aa_level) &&
-        ((*rootp)->aa_level != 0))
+    if ((aa_lvl (LLINK(root)) == aa_lvl (root)) &&
+        (aa_lvl (root) != 0))
     {
-        save          = LLINK(*rootp);
-        LLINK(*rootp) = RLINK(save);
-        RLINK(save)   = *rootp;
-        *rootp        = save;
+        save = LLINK(root);
+        aa_set_child (root, LEFT,  RLINK(save));
+        aa_set_child (save, RIGHT, root);
+        aa_fix (root, mon);
+        aa_fix (save, mon);
+        root = save;
     }
+    return (root);
 }
 
-static inline void
-split (aa_node_t **rootp)
+static inline aa_node_t*
+split (aa_node_t          *root,
+       const aa_monoid_t  *mon)
 {
     aa_node_t *save;
 
-
-    if ((RLINK(RLINK(*rootp))->aa_level == (*rootp)->aa_level) &&
-        ((*rootp)->aa_level != 0))
+    if ((aa_lvl (RLINK(RLINK(root))) == aa_lvl (root)) &&
+        (aa_lvl (root) != 0))
     {
-       
-        save          = RLINK(*rootp);
-        RLINK(*rootp) = LLINK(save);
-        LLINK(save)   = *rootp;
-        *rootp        = save;
-        ++(*rootp)->aa_level;
+        save = RLINK(root);
+        aa_set_right (root, LLINK(save), save);
+        aa_set_child (save, LEFT,  root);
+        aa_set_lvl   (save, aa_lvl (save) + 1);
+        aa_fix (root, mon);
+        aa_fix (save, mon);
+        root = save;
     }
+    return (root);
 }
 
+/*
+ * Link a prepared node. The descent records, with each node on the path,
+ * the side it was left by (dirs), so that the climb back relinks every
+ * rebalanced subtree without consulting the comparator again.
+ */
 static void
-aa_int_insert (aa_node_t **rootp,
-               uintptr_t   data,
-               aa_cmp_t    cmp)
+aa_int_link (aa_node_t         **rootp,
+             aa_node_t          *n,
+             aa_cmp_t            cmp,
+             const aa_monoid_t  *mon)
 {
     aa_node_t *up [256];
+    uint8_t    dirs [256];
     aa_node_t *it;
     int        top;
     int        dir;
     int        rc;
 
+    aa_fix (n, mon);
     if (*rootp == AA_NIL) 
     {
-        aan_new (rootp, data, 1);
+        *rootp = n;
         return;
     }
 
     it  = *rootp;
     top = 0;
-    dir = 0;
 
     for (;;)
     {
-        up[top++] = it;
-        rc        = (*cmp)((void *)it->aa_data, (void *)data);
-        dir       = (rc < 0);
+        /* An equal key goes right: after those already there */
+        rc          = (*cmp)((void *)it->aa_data, (void *)n->aa_data);
+        dir         = (rc <= 0);
+        up [top]    = it;
+        dirs [top]  = dir;
+        ++top;
 
-        if (it->aa_link[dir] == AA_NIL)
+        if (aa_child (it, dir) == AA_NIL)
             break;
 
-        it = (rc < 0) ? RLINK(it) : LLINK(it);
+        it = aa_child (it, dir);
     }
 
-    aan_new (&it->aa_link[dir], data, 1);
+    /* n follows it, or takes over it's successor */
+    aa_set_right (n, AA_NIL, (dir == RIGHT) ? aa_thread (it) : it);
+    aa_set_child (it, dir, n);
 
     while (--top >= 0)
     {
-        if (top != 0)
-        {
-            rc = (*cmp)((void *) RLINK(up [top - 1])->aa_data,
-                        (void *) up [top]->aa_data);
-            dir = (rc == 0);
-        }
-
-        skew  (&up [top]);
-        split (&up [top]);
+        aa_fix (up [top], mon);
+        up [top] = skew  (up [top], mon);
+        up [top] = split (up [top], mon);
 
         if (top != 0)
-            RLINK(up [top - 1]) = up [top];
+            aa_set_child (up [top - 1], dirs [top - 1], up [top]);
         else
-        *rootp = up [top];
+            *rootp = up [top];
     }
 }
 
+static rc_t
+aa_int_insert (aa_node_t         **rootp,
+               uintptr_t           data,
+               aa_cmp_t            cmp,
+               const aa_monoid_t  *mon,
+               aa_node_t         **nodep)
+{
+    aa_node_t *n;
+
+    aan_new (&n, data, 1);
+    if (n == NULL)
+    {
+        *nodep = AA_NIL;
+        return (RFAIL);
+    }
+    aa_int_link (rootp, n, cmp, mon);
+    *nodep = n;
+    return (ROK);
+}
+
 rc_t
 aa_int_find (aa_node_t  *root,
              void       *data,
@@ -180,71 +319,118 @@ aa_int_find (aa_node_t  *root,
     return ((node != AA_NIL) ? ROK : RFAIL); 
 }
 
-static void
-aa_int_remove (aa_node_t **rootp,
-               aa_node_t  *node,
-               aa_cmp_t    cmp)
+/*
+ * Unlinks and frees a node holding data's key. A node with two children
+ * is replaced by its in-order successor (the heir) relinked in its place,
+ * rather than by copying the heir's data over it, so that handles to
+ * other nodes stay valid. As on insert, the path is kept with the side
+ * taken at each step and the climb makes no comparisons.
+ */
+static rc_t
+aa_int_remove (aa_node_t         **rootp,
+               void               *data,
+               aa_cmp_t            cmp,
+               const aa_monoid_t  *mon)
 {
     aa_node_t *up [256];
+    uint8_t    dirs [256];
     aa_node_t *it;
     aa_node_t *heir;
-    aa_node_t *prev;
+    aa_node_t *x;
     int        top;
-    int        dir;
-    int        dir2;
+    int        pos;
     int        rc;
 
-    if (*rootp == AA_NIL)
-        return;
-
     it  = *rootp;
     top = 0;
-    dir = 0;
 
-    for (::)
+    for (;;)
     {
-        up [top++] = it;
         if (it == AA_NIL)
-            return;
+            return (RFAIL);
 
-        rc = (*cmp)(node->aa_data, it->aa_data);
+        rc = (*cmp)(data, (void *) it->aa_data);
         if (rc == 0)
             break;
-        dir = (rc > 0);
-        it  = it->aa_link [dir];
+        up [top]   = it;
+        dirs [top] = (rc > 0);
+        ++top;
+        it = aa_child (it, dirs [top - 1]);
     }
 
-    if (LLINK(it) == AA_NIL || 
-        RLINK(it) == AA_NIL)
+    if ((LLINK(it) == AA_NIL) || 
+        (RLINK(it) == AA_NIL))
     {
-        dir2 = (LLINK(it) == AA_NIL);
-
-        if (--top != 0)
-            up [top - 1]->aa_link [dir] = it->aa_link [dir2];
+        x = aa_child (it, LLINK(it) == AA_NIL);
+        if ((top != 0) && (dirs [top - 1] == RIGHT))
+            aa_set_right (up [top - 1], x, aa_thread (it));
+        else if (top != 0)
+            aa_set_child (up [top - 1], LEFT, x);
         else
-            *rootp = RLINK(it);
+            *rootp = x;
     }
     else
     {
-        heir = RLINK(it);
-        prev = it;
+        /* it stays on the path; the heir takes its slot there below */
+        pos         = top;
+        up [top]    = it;
+        dirs [top]  = RIGHT;
+        ++top;
 
+        heir = RLINK(it);
         while (LLINK(heir) != AA_NIL)
         {
-            up[top++] = heir;
-            prev      = heir;
-            heir      = LLINK(heir);
+            up [top]   = heir;
+            dirs [top] = LEFT;
+            ++top;
+            heir       = LLINK(heir);
         }
 
-        /* This is not good: handes must be immutable! */
-        it->aa_data                 = heir->aa_data;
-        prev->aa_link[(prev == it)] = RLINK(heir);
+        /* Unless it is the heir's parent, the heir came down a left link */
+        if (up [top - 1] != it)
+        {
+            aa_set_child (up [top - 1], LEFT, RLINK(heir));
+            aa_set_child (heir, RIGHT, RLINK(it));
+        }
+        aa_set_child (heir, LEFT, LLINK(it));
+        aa_set_lvl   (heir, aa_lvl (it));
+        up [pos] = heir;
+#ifdef AA_THREADED
+        /* it's predecessor, rightmost on its left, was threaded to it */
+        for (x = LLINK(it); RLINK(x) != AA_NIL; x = RLINK(x))
+            ;
+        aa_set_right (x, AA_NIL, heir);
+#endif
     }
+    aan_delete (&it);
 
     while (--top >= 0)
     {
+        x = up [top];
+        aa_fix (x, mon);
+        if ((aa_lvl (LLINK(x)) < aa_lvl (x) - 1) ||
+            (aa_lvl (RLINK(x)) < aa_lvl (x) - 1))
+        {
+            aa_set_lvl (x, aa_lvl (x) - 1);
+            if (aa_lvl (RLINK(x)) > aa_lvl (x))
+                aa_set_lvl (RLINK(x), aa_lvl (x));
+
+            x = skew (x, mon);
+            aa_set_child (x, RIGHT, skew (RLINK(x), mon));
+            heir = RLINK(x);
+            if (heir != AA_NIL)
+                aa_set_child (heir, RIGHT, skew (RLINK(heir), mon));
+            x = split (x, mon);
+            aa_set_child (x, RIGHT, split (RLINK(x), mon));
+            up [top] = x;
+        }
 
+        if (top != 0)
+            aa_set_child (up [top - 1], dirs [top - 1], up [top]);
+        else
+            *rootp = up [top];
     }
+    return (ROK);
 }
 
 int
@@ -264,10 +450,774 @@ aa_int_height (aa_node_t  *root)
     }
     return 0;
 }
+
+/* Stable bottom-up merge sort of n items; tmp has room for n */
+static void
+aa_sort (void      **items,
+         void      **tmp,
+         uint32_t    n,
+         aa_cmp_t    cmp)
+{
+    void     **src = items;
+    void     **dst = tmp;
+    void     **swap;
+    uint32_t   width;
+    uint32_t   lo, mid, hi;
+    uint32_t   i, j, k;
+
+    for (width = 1; width < n; width *= 2)
+    {
+        for (lo = 0; lo < n; lo += 2 * width)
+        {
+            mid = (lo + width < n)     ? lo + width     : n;
+            hi  = (lo + 2 * width < n) ? lo + 2 * width : n;
+            for (i = lo, j = mid, k = lo; k < hi; ++k)
+            {
+                if ((i < mid) &&
+                    ((j == hi) ||
+                     ((*cmp)(src [j], src [i]) >= 0)))
+                    dst [k] = src [i++];
+                else
+                    dst [k] = src [j++];
+            }
+        }
+        swap = src;
+        src  = dst;
+        dst  = swap;
+    }
+    if (src != items)
+        for (i = 0; i < n; ++i)
+            items [i] = src [i];
+}
+
+/*
+ * Link vec [lo, hi] (in key order) into a balanced subtree. With the
+ * midpoint rounded down the right half is never smaller than the left, so
+ * a node one level above its left child leaves the right child at most
+ * one level down and never two right links level in a row: a valid AA
+ * tree with no skews or splits. succ is the node following vec [hi].
+ */
+static aa_node_t*
+aa_int_build (aa_node_t         **vec,
+              int64_t             lo,
+              int64_t             hi,
+              aa_node_t          *succ,
+              const aa_monoid_t  *mon)
+{
+    aa_node_t *node;
+    int64_t    mid;
+
+    if (lo > hi)
+        return (AA_NIL);
+
+    mid            = lo + (hi - lo) / 2;
+    node           = vec [mid];
+    aa_set_child (node, LEFT,  aa_int_build (vec, lo, mid - 1, node, mon));
+    aa_set_right (node, aa_int_build (vec, mid + 1, hi, succ, mon), succ);
+    aa_set_lvl   (node, aa_lvl (LLINK(node)) + 1);
+    aa_fix (node, mon);
+    return (node);
+}
+
+/* Free the subtree with constant stack: rotate left children up first */
+static void
+aa_int_destroy (aa_node_t  *node,
+                aa_dtor_t   dtor)
+{
+    aa_node_t *left;
+    aa_node_t *next;
+
+    while (node != AA_NIL)
+    {
+        left = LLINK(node);
+        if (left != AA_NIL)
+        {
+            aa_set_child (node, LEFT,  RLINK(left));
+            aa_set_child (left, RIGHT, node);
+            node        = left;
+            continue;
+        }
+        next = RLINK(node);
+        if (dtor)
+            (*dtor) ((void *) node->aa_data);
+        free (node);
+        node = next;
+    }
+}
+
+static inline void
+aa_iter_push (aa_iter_t  *iter,
+              aa_node_t  *node)
+{
+    for (; node != AA_NIL; node = LLINK(node))
+        iter->ai_stack [iter->ai_top++] = node;
+}
+
+static inline aa_node_t*
+aa_iter_cur (aa_iter_t  *iter)
+{
+    return ((iter->ai_top > 0) ? iter->ai_stack [iter->ai_top - 1] : AA_NIL);
+}
+
 /**************************************************************************
  *                          EXTERN FUNCTIONS                              *
  **************************************************************************/
 
+aa_node_t*
+aa_nilp (void)
+{
+    return (AA_NIL);
+}
+
+/**
+ * @brief 
+ *
+ * @param treep Receives the new, empty tree; NULL if memory runs out
+ */
+void
+aa_new (aa_tree_t **treep)
+{
+    aa_tree_t *tree;
+
+    tree = calloc (1, sizeof(*tree));
+    if (tree)
+        tree->aat_root = AA_NIL;
+    *treep = tree;
+}
+
+/**
+ * @brief Free the tree and all its nodes, in O(n) with constant stack.
+ *
+ * @param treep
+ * @param dtor  Called on each node's data, in key order; may be NULL
+ */
+void
+aa_delete (aa_tree_t **treep,
+           aa_dtor_t   dtor)
+{
+    if (!treep || !*treep)
+        return;
+
+    aa_int_destroy ((*treep)->aat_root, dtor);
+    free (*treep);
+    *treep = NULL;
+}
+
+/**
+ * @brief Equal keys are kept; a new one goes after those already there.
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ * @param nodep Receives the new node, AA_NIL (aa_nilp) if memory runs out
+ */
+void
+aa_insert (aa_tree_t  *tree,
+           void       *item,
+           aa_cmp_t    cmp,
+           aa_node_t **nodep)
+{
+    if (aa_int_insert (&tree->aat_root, (uintptr_t) item, cmp, 
+                       AA_MON (tree), nodep) == ROK)
+        ++tree->aat_cnt;
+}
+
+/**
+ * @brief 
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ * @param nodep Receives the node, AA_NIL (aa_nilp) if item is absent
+ */
+void
+aa_find (aa_tree_t  *tree,
+         void       *item,
+         aa_cmp_t    cmp,
+         aa_node_t **nodep)
+{
+    (void) aa_int_find (tree->aat_root, item, cmp, nodep);
+}
+
+/**
+ * @brief Remove and free a node with item's key. Other nodes stay where
+ *        they are in memory, so handles to them remain valid.
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ *
+ * @return ROK; RFAIL if no node has item's key.
+ */
+rc_t
+aa_remove (aa_tree_t  *tree,
+           void       *item,
+           aa_cmp_t    cmp)
+{
+    if (aa_int_remove (&tree->aat_root, item, cmp, AA_MON (tree)) != ROK)
+        return (RFAIL);
+    --tree->aat_cnt;
+    return (ROK);
+}
+
+/**
+ * @brief Build the tree from items already sorted by the tree's comparator
+ *        in O(n), without comparisons, skews or splits.
+ *
+ * @param tree  Empty tree
+ * @param items Sorted items
+ * @param n
+ *
+ * @return ROK on success; RFAIL if the tree is not empty or memory runs
+ *         out.
+ */
+rc_t
+aa_build_sorted (aa_tree_t  *tree,
+                 void      **items,
+                 uint32_t    n)
+{
+    aa_node_t **vec;
+    uint32_t    i;
+
+    if (tree->aat_root != AA_NIL)
+        return (RFAIL);
+    if (n == 0)
+        return (ROK);
+
+    vec = malloc ((size_t) n * sizeof(*vec));
+    if (vec == NULL)
+        return (RFAIL);
+    for (i = 0; i < n; ++i)
+    {
+        aan_new (&vec [i], (uintptr_t) items [i], 1);
+        if (vec [i] == NULL)
+        {
+            while (i-- > 0)
+                aan_delete (&vec [i]);
+            free (vec);
+            return (RFAIL);
+        }
+    }
+
+    tree->aat_root = aa_int_build (vec, 0, (int64_t) n - 1, AA_NIL,
+                                   AA_MON (tree));
+    tree->aat_cnt  = n;
+    free (vec);
+    return (ROK);
+}
+
+/* Batches at least this fraction of the tree size are merged and rebuilt */
+#define AA_BATCH_REBUILD_DIV    4
+
+/**
+ * @brief Insert a batch of items. The batch is sorted first (the items
+ *        array itself is left alone). A batch that is large relative to
+ *        the tree is merged with the tree's nodes and the tree rebuilt in
+ *        O(n + m); smaller ones are inserted one by one. Existing nodes
+ *        are relinked, not copied, so handles stay valid either way.
+ *
+ * @param tree
+ * @param items
+ * @param n
+ * @param cmp
+ *
+ * @return ROK on success; RFAIL if memory runs out (the tree is left
+ *         unchanged then).
+ */
+rc_t
+aa_insert_batch (aa_tree_t  *tree,
+                 void      **items,
+                 uint32_t    n,
+                 aa_cmp_t    cmp)
+{
+    void      **sorted;
+    aa_node_t **vec;
+    aa_node_t  *node;
+    aa_iter_t   iter;
+    uint32_t    cnt;
+    uint32_t    i, j, k;
+
+    if (n == 0)
+        return (ROK);
+
+    cnt    = tree->aat_cnt;
+    sorted = malloc (2 * (size_t) n * sizeof(*sorted));
+    vec    = malloc (((size_t) n + cnt) * sizeof(*vec));
+    if ((sorted == NULL) || (vec == NULL))
+    {
+        free (sorted);
+        free (vec);
+        return (RFAIL);
+    }
+    for (i = 0; i < n; ++i)
+        sorted [i] = items [i];
+    aa_sort (sorted, sorted + n, n, cmp);
+
+    /* Allocate everything up front so failure leaves the tree untouched */
+    for (i = 0; i < n; ++i)
+    {
+        aan_new (&vec [cnt + i], (uintptr_t) sorted [i], 1);
+        if (vec [cnt + i] == NULL)
+        {
+            while (i-- > 0)
+                aan_delete (&vec [cnt + i]);
+            free (sorted);
+            free (vec);
+            return (RFAIL);
+        }
+    }
+
+    if ((uint64_t) n * AA_BATCH_REBUILD_DIV >= cnt)
+    {
+        /* Merge: existing nodes in order, then the new ones, into vec */
+        node = aa_iter_first (tree, &iter);
+        for (j = cnt, k = 0; k < cnt + n; ++k)
+        {
+            if ((node != AA_NIL) &&
+                ((j == cnt + n) ||
+                 ((*cmp)((void *) vec [j]->aa_data, 
+                         (void *) node->aa_data) >= 0)))
+            {
+                vec [k] = node;
+                node    = aa_iter_next (&iter);
+            }
+            else
+                vec [k] = vec [j++];
+        }
+        tree->aat_root = aa_int_build (vec, 0, (int64_t) cnt + n - 1, AA_NIL,
+                                       AA_MON (tree));
+    }
+    else
+    {
+        for (i = 0; i < n; ++i)
+            aa_int_link (&tree->aat_root, vec [cnt + i], cmp, AA_MON (tree));
+    }
+    tree->aat_cnt = cnt + n;
+
+    free (sorted);
+    free (vec);
+    return (ROK);
+}
+
+/**
+ * @brief In-order walk; visit must not change the tree.
+ *
+ * @param tree
+ * @param cb    Passed through to visit
+ * @param visit
+ */
+void
+aa_walk (aa_tree_t  *tree,
+         void       *cb,
+         aa_visit_t  visit)
+{
+    aa_iter_t  iter;
+    aa_node_t *node;
+
+    /* 
+     * Even threaded, the stack cursor is the faster full scan: the next
+     * node's address comes off the stack rather than out of the node just
+     * visited, so cache misses overlap instead of queueing. 
+     */
+    for (node = aa_iter_first (tree, &iter); 
+         node != AA_NIL; 
+         node = aa_iter_next (&iter))
+        (*visit) (cb, node);
+}
+
+int
+aa_height (aa_tree_t  *tree)
+{
+    return (aa_int_height (tree->aat_root));
+}
+
+/**
+ * @brief Start a cursor at the smallest key. A cursor holds the path to
+ *        its node, so it steps in O(1) amortized without parent links;
+ *        it is invalidated by any change to the tree.
+ *
+ * @param tree
+ * @param iter
+ *
+ * @return The first node, AA_NIL (aa_nilp) if the tree is empty.
+ */
+aa_node_t*
+aa_iter_first (aa_tree_t  *tree,
+               aa_iter_t  *iter)
+{
+    iter->ai_top = 0;
+    aa_iter_push (iter, tree->aat_root);
+    return (aa_iter_cur (iter));
+}
+
+/**
+ * @brief Start a cursor at the first node whose key is not below item.
+ *
+ * @param tree
+ * @param iter
+ * @param item
+ * @param cmp
+ */
+aa_node_t*
+aa_iter_seek (aa_tree_t  *tree,
+              aa_iter_t  *iter,
+              void       *item,
+              aa_cmp_t    cmp)
+{
+    aa_node_t *node = tree->aat_root;
+
+    iter->ai_top = 0;
+    while (node != AA_NIL)
+    {
+        if ((*cmp)(item, (void *) node->aa_data) <= 0)
+        {
+            iter->ai_stack [iter->ai_top++] = node;
+            node = LLINK(node);
+        }
+        else
+            node = RLINK(node);
+    }
+    return (aa_iter_cur (iter));
+}
+
+/**
+ * @brief Step to the next node in key order.
+ *
+ * @param iter
+ *
+ * @return The next node, AA_NIL (aa_nilp) past the last one.
+ */
+aa_node_t*
+aa_iter_next (aa_iter_t  *iter)
+{
+    aa_node_t *node;
+
+    if (iter->ai_top == 0)
+        return (AA_NIL);
+    node = iter->ai_stack [--iter->ai_top];
+    aa_iter_push (iter, RLINK(node));
+    return (aa_iter_cur (iter));
+}
+
+#ifdef AA_AUGMENT
+static void
+aa_int_refix (aa_node_t          *node,
+              const aa_monoid_t  *mon)
+{
+    if (node == AA_NIL)
+        return;
+    aa_int_refix (LLINK(node), mon);
+    aa_int_refix (RLINK(node), mon);
+    aa_fix (node, mon);
+}
+
+/**
+ * @brief Keep range aggregates under mon from now on; those of the nodes
+ *        already in the tree are computed here, O(n). skew and split
+ *        keep them current afterwards, at O(1) per rotation.
+ *
+ * @param tree
+ * @param mon   NULL to stop; must outlive its use by the tree
+ */
+void
+aa_set_monoid (aa_tree_t          *tree,
+               const aa_monoid_t  *mon)
+{
+    tree->aat_mon = mon;
+    aa_int_refix (tree->aat_root, mon);
+}
+
+/**
+ * @brief Combine, in key order, the values of all items in [lo, hi].
+ *        Below the node where the paths to lo and hi part, every subtree
+ *        hanging off the inner side of either path lies wholly inside
+ *        the range and contributes its aggregate as is: O(log n).
+ *
+ * @param tree  With a monoid set (aa_set_monoid)
+ * @param lo
+ * @param hi
+ * @param cmp
+ *
+ * @return am_identity if no item is in range.
+ */
+uintptr_t
+aa_range_agg (aa_tree_t  *tree,
+              void       *lo,
+              void       *hi,
+              aa_cmp_t    cmp)
+{
+    const aa_monoid_t *mon  = tree->aat_mon;
+    aa_node_t         *node = tree->aat_root;
+    aa_node_t         *fork;
+    uintptr_t          lacc, racc;
+
+    /* Find the topmost node inside the range */
+    while (node != AA_NIL)
+    {
+        if ((*cmp)((void *) node->aa_data, lo) < 0)
+            node = RLINK(node);
+        else if ((*cmp)((void *) node->aa_data, hi) > 0)
+            node = LLINK(node);
+        else
+            break;
+    }
+    if (node == AA_NIL)
+        return (mon->am_identity);
+    fork = node;
+
+    /* Left of the fork: every node not below lo brings its right subtree */
+    lacc = mon->am_identity;
+    for (node = LLINK(fork); node != AA_NIL; )
+    {
+        if ((*cmp)((void *) node->aa_data, lo) >= 0)
+        {
+            if (RLINK(node) != AA_NIL)
+                lacc = (*mon->am_combine) (RLINK(node)->aa_agg, lacc);
+            lacc = (*mon->am_combine) ((*mon->am_value) ((void *) node->aa_data), 
+                                       lacc);
+            node = LLINK(node);
+        }
+        else
+            node = RLINK(node);
+    }
+
+    /* And mirrored on the right */
+    racc = mon->am_identity;
+    for (node = RLINK(fork); node != AA_NIL; )
+    {
+        if ((*cmp)((void *) node->aa_data, hi) <= 0)
+        {
+            if (LLINK(node) != AA_NIL)
+                racc = (*mon->am_combine) (racc, LLINK(node)->aa_agg);
+            racc = (*mon->am_combine) (racc, 
+                                       (*mon->am_value) ((void *) node->aa_data));
+            node = RLINK(node);
+        }
+        else
+            node = LLINK(node);
+    }
+
+    return ((*mon->am_combine) ((*mon->am_combine) (lacc, 
+                                    (*mon->am_value) ((void *) fork->aa_data)),
+                                racc));
+}
+#endif
+
+#ifdef AA_THREADED
+/**
+ * @brief 
+ *
+ * @param tree
+ *
+ * @return The node with the smallest key, AA_NIL (aa_nilp) if none.
+ */
+aa_node_t*
+aa_first (aa_tree_t  *tree)
+{
+    aa_node_t *node = tree->aat_root;
+
+    if (node != AA_NIL)
+        while (LLINK(node) != AA_NIL)
+            node = LLINK(node);
+    return (node);
+}
+
+/**
+ * @brief The first node whose key is not below item, AA_NIL (aa_nilp) if
+ *        none; continue a range scan from it with aa_next().
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ */
+aa_node_t*
+aa_lower_bound (aa_tree_t  *tree,
+                void       *item,
+                aa_cmp_t    cmp)
+{
+    aa_node_t *node  = tree->aat_root;
+    aa_node_t *bound = AA_NIL;
+
+    while (node != AA_NIL)
+    {
+        if ((*cmp)(item, (void *) node->aa_data) <= 0)
+        {
+            bound = node;
+            node  = LLINK(node);
+        }
+        else
+            node = RLINK(node);
+    }
+    return (bound);
+}
+
+/**
+ * @brief In-order successor, by following links only: a thread leads
+ *        straight to it, otherwise it is the leftmost node of the right
+ *        subtree. A full scan follows each link at most once, so a step
+ *        costs O(1) amortized (O(log n) at worst) and needs no stack.
+ *
+ * @param node
+ *
+ * @return The next node, AA_NIL (aa_nilp) after the last one.
+ */
+aa_node_t*
+aa_next (aa_node_t  *node)
+{
+    if (aa_threaded (node))
+        return (aa_thread (node));
+
+    node = RLINK(node);
+    while (LLINK(node) != AA_NIL)
+        node = LLINK(node);
+    return (node);
+}
+#endif
+
+/* Fill Eytzinger slot k and its subtree from the cursor, in key order */
+static void
+aa_freeze_fill (aa_frozen_t  *fz,
+                uint64_t      k,
+                aa_iter_t    *iter,
+                aa_node_t   **nodep)
+{
+    if (k > fz->afz_cnt)
+        return;
+    aa_freeze_fill (fz, 2 * k, iter, nodep);
+    fz->afz_keys [k] = (*nodep)->aa_data;
+    *nodep           = aa_iter_next (iter);
+    aa_freeze_fill (fz, 2 * k + 1, iter, nodep);
+}
+
+/**
+ * @brief Copy the tree's keys into a frozen, read-only search array,
+ *        one word per key. The tree itself is left alone and may be
+ *        changed or freed afterwards.
+ *
+ * @param tree
+ * @param fz    Release with aa_frozen_free()
+ *
+ * @return ROK on success; RFAIL if memory runs out.
+ */
+rc_t
+aa_freeze (aa_tree_t    *tree,
+           aa_frozen_t  *fz)
+{
+    aa_iter_t  iter;
+    aa_node_t *node;
+    void      *keys;
+
+    if (posix_memalign (&keys, 64,
+                        ((size_t) tree->aat_cnt + 1) * sizeof(uintptr_t)))
+        return (RFAIL);
+    fz->afz_keys     = keys;
+    fz->afz_cnt      = tree->aat_cnt;
+    fz->afz_keys [0] = 0;
+
+    node = aa_iter_first (tree, &iter);
+    aa_freeze_fill (fz, 1, &iter, &node);
+    return (ROK);
+}
+
+void
+aa_frozen_free (aa_frozen_t  *fz)
+{
+    free (fz->afz_keys);
+    fz->afz_keys = NULL;
+    fz->afz_cnt  = 0;
+}
+
+/* Keys per 64 byte line: a node's descendants 3 levels down share one */
+#define AA_FRZ_LINE_KEYS    (64 / sizeof(uintptr_t))
+
+/**
+ * @brief Index of the first key not below item, 0 if every key is.
+ *
+ * The descent never branches on the comparison, it only adds its result
+ * to the index, so there are no mispredictions. The loop runs the same
+ * number of times for every item; the line holding the node three levels
+ * down is prefetched on each step, so memory is fetched ahead of need.
+ *
+ * @param fz
+ * @param item
+ * @param cmp
+ */
+uint32_t
+aa_frozen_lower_bound (aa_frozen_t  *fz,
+                       void         *item,
+                       aa_cmp_t      cmp)
+{
+    const uintptr_t *keys = fz->afz_keys;
+    uint64_t         n    = fz->afz_cnt;
+    uint64_t         k    = 1;
+
+    while (k <= n)
+    {
+        __builtin_prefetch (keys + k * AA_FRZ_LINE_KEYS);
+        k = 2 * k + ((*cmp)((void *) keys [k], item) < 0);
+    }
+    /* Undo the right turns taken after the last left one */
+    k >>= __builtin_ffsll (~k);
+    return ((uint32_t) k);
+}
+
+/**
+ * @brief Index of a key equal to item, 0 if there is none.
+ *
+ * @param fz
+ * @param item
+ * @param cmp
+ */
+uint32_t
+aa_frozen_find (aa_frozen_t  *fz,
+                void         *item,
+                aa_cmp_t      cmp)
+{
+    uint32_t i;
+
+    i = aa_frozen_lower_bound (fz, item, cmp);
+    if ((i != 0) &&
+        ((*cmp)((void *) fz->afz_keys [i], item) == 0))
+        return (i);
+    return (0);
+}
+
+uint32_t
+aa_frozen_first (aa_frozen_t  *fz)
+{
+    uint64_t k;
+
+    if (fz->afz_cnt == 0)
+        return (0);
+    for (k = 1; 2 * k <= fz->afz_cnt; k *= 2)
+        ;
+    return ((uint32_t) k);
+}
+
+/**
+ * @brief Index of the next key in order after index i, 0 after the last.
+ *
+ * @param fz
+ * @param i
+ */
+uint32_t
+aa_frozen_next (aa_frozen_t  *fz,
+                uint32_t      i)
+{
+    uint64_t k = i;
+
+    if (k == 0)
+        return (0);
+    if (2 * k + 1 <= fz->afz_cnt)
+    {
+        for (k = 2 * k + 1; 2 * k <= fz->afz_cnt; k *= 2)
+            ;
+        return ((uint32_t) k);
+    }
+    k >>= __builtin_ffsll (~k);
+    return ((uint32_t) k);
+}
+
 #ifdef ETEST
 
 int
@@ -282,24 +1232,41 @@ intprint (void *cb __attribute__((unused)), aa_node_t *n)
     printf("%d ", (int) n->aa_data);
 }
 
+#ifdef AA_AUGMENT
+uintptr_t
+intval (void *a)
+{
+    return ((uintptr_t) a);
+}
+
+uintptr_t
+intsum (uintptr_t a, uintptr_t b)
+{
+    return (a + b);
+}
+#endif
+
 int
 main (int argc, char **argv)
 {
-    aa_node_t *n = AA_NIL;
+    aa_tree_t *t;
     aa_node_t *p = AA_NIL;
+    aa_iter_t  iter;
+    void      *items [1000];
     int        nfound = 0;
     int        found  = 0;
     int        i;
 
+    aa_new (&t);
     for (i = 0; i <  4000000; ++i) {
-        aa_int_insert (&n, i, intcmp);
-        if (n == AA_NIL)
+        aa_insert (t, (void*) i, intcmp, &p);
+        if (p == AA_NIL)
             printf ("insert(%d) failed!\n", (i+1));
     }
 
    for (i = 0; i < 4000000; ++i)
     {
-        aa_int_find (n, (void*) i, intcmp, &p);
+        aa_find (t, (void*) i, intcmp, &p);
         if (p == AA_NIL) {
             printf ("%d not foubd!\n", i);
             ++nfound;
@@ -308,11 +1275,301 @@ main (int argc, char **argv)
             ++found;
     }
 
-    printf ("found %d; missed %d\n", found, nfound);
-    printf ("root %d\n", n->aa_data);
+    printf ("found %d; missed %d; %d byte nodes\n", found, nfound,
+            (int) sizeof(aa_node_t));
+    printf ("root %d\n", t->aat_root->aa_data);
     printf ("Height of AA-tree is %d\n",
-            aa_int_height (n));
+            aa_height (t));
+
+    /* Remove the odd keys again */
+    for (i = 1; i < 4000000; i += 2)
+    {
+        if (aa_remove (t, (void*) i, intcmp) != ROK)
+            printf ("remove(%d) failed!\n", i);
+    }
+    for (found = nfound = 0, i = 0; i < 4000000; ++i)
+    {
+        aa_find (t, (void*) i, intcmp, &p);
+        if ((p != AA_NIL) != !(i & 1))
+            ++nfound;
+        else
+            ++found;
+    }
+    printf ("after remove: right %d; wrong %d; height %d\n",
+            found, nfound, aa_height (t));
+
+    /* Put back a few odd keys in one batch, then walk from 2001 on */
+    for (i = 0; i < 1000; ++i)
+        items [i] = (void*) (3999 - 2 * i);
+    aa_insert_batch (t, items, 1000, intcmp);
+    for (i = 2001, p = aa_iter_seek (t, &iter, (void*) 2001, intcmp); 
+         (p != AA_NIL) && (i < 4000); 
+         ++i, p = aa_iter_next (&iter))
+        assert (p->aa_data == (uintptr_t) i);
+    printf ("batch: %u nodes, height %d\n", t->aat_cnt, aa_height (t));
+#ifdef AA_THREADED
+    for (i = 2001, p = aa_lower_bound (t, (void*) 2001, intcmp); 
+         (p != AA_NIL) && (i < 4000); 
+         ++i, p = aa_next (p))
+        assert (p->aa_data == (uintptr_t) i);
+    for (i = 0, p = aa_first (t); p != AA_NIL; p = aa_next (p))
+        ++i;
+    assert (i == t->aat_cnt);
+#endif
+
+    /* Freeze, and compare with the tree */
+    {
+        aa_frozen_t fz;
+        uint32_t    k;
+
+        aa_freeze (t, &fz);
+        for (k = aa_frozen_first (&fz), p = aa_iter_first (t, &iter);
+             p != AA_NIL;
+             k = aa_frozen_next (&fz, k), p = aa_iter_next (&iter))
+            assert ((k != 0) && (aa_frozen_data (&fz, k) == p->aa_data));
+        assert (k == 0);
+        for (found = nfound = 0, i = 0; i < 4000000; ++i)
+        {
+            aa_find (t, (void*) i, intcmp, &p);
+            if ((p != AA_NIL) != (aa_frozen_find (&fz, (void*) i, intcmp) != 0))
+                ++nfound;
+            else
+                ++found;
+        }
+        printf ("frozen: right %d; wrong %d\n", found, nfound);
+        aa_frozen_free (&fz);
+    }
+#ifdef AA_AUGMENT
+    /* Range sums, checked against the keys still present */
+    {
+        static const aa_monoid_t sum = { intval, intsum, 0 };
+        uintptr_t   want;
+        int         lo, hi;
+
+        aa_set_monoid (t, &sum);
+        for (i = 0; i < 4000; i += 2)
+            aa_remove (t, (void*) i, intcmp);
+        for (found = nfound = 0, lo = 0; lo < 4000000; lo += 99991)
+        {
+            hi = lo + 5000;
+            for (want = 0, i = lo; (i <= hi) && (i < 4000000); ++i)
+                if (((i & 1) == 0) ? (i >= 4000) : ((i > 2000) && (i < 4000)))
+                    want += i;
+            if (aa_range_agg (t, (void*) lo, (void*) hi, intcmp) == want)
+                ++found;
+            else
+                ++nfound;
+        }
+        printf ("range sums: right %d; wrong %d\n", found, nfound);
+    }
+#endif
+    aa_delete (&t, NULL);
+
+    /* 
+     * Equal keys keep insertion order, one at a time or by batch: six more
+     * 7s by aa_insert, three by finger search, two by merge and rebuild.
+     */
+    {
+        aa_node_t *dup [12];
+        int        ndup = 0;
+
+        aa_new (&t);
+        for (i = 0; i < 1000; ++i)
+            aa_insert (t, (void*) i, intcmp, &p);
+        aa_find (t, (void*) 7, intcmp, &dup [ndup++]);
+        for (i = 0; i < 6; ++i)
+            aa_insert (t, (void*) 7, intcmp, &dup [ndup++]);
+
+        for (i = 0; i < 3; ++i)
+            items [i] = (void*) 7;
+        assert (3 * AA_BATCH_REBUILD_DIV < t->aat_cnt);
+        aa_insert_batch (t, items, 3, intcmp);
+        for (i = 0, p = aa_iter_seek (t, &iter, (void*) 7, intcmp); 
+             i < 10; 
+             ++i, p = aa_iter_next (&iter))
+            if (i < ndup)
+                assert (p == dup [i]);
+            else
+                dup [ndup++] = p;
+
+        for (i = 0; i < 400; ++i)
+            items [i] = (void*) ((i < 2) ? 7 : 1000 + i);
+        assert (400 * AA_BATCH_REBUILD_DIV >= t->aat_cnt);
+        aa_insert_batch (t, items, 400, intcmp);
+        for (i = 0, p = aa_iter_seek (t, &iter, (void*) 7, intcmp); 
+             i < 12; 
+             ++i, p = aa_iter_next (&iter))
+        {
+            assert (p->aa_data == 7);
+            if (i < ndup)
+                assert (p == dup [i]);
+        }
+        assert (p->aa_data == 8);
+        printf ("duplicates: in insertion order\n");
+        aa_delete (&t, NULL);
+    }
 
     return 0;
 }
+
+#elif defined(EBENCH)
+
+/*
+ * Head to head with the red-black tree on the same keys:
+ * cc -O2 -DEBENCH aatree.c rbtree.c
+ */
+
+#include <time.h>
+
+#include "rbtree.h"
+
+#define BENCH_N     1000000
+
+static int
+aa_bench_cmp (void *a, void *b)
+{
+    return (((uintptr_t) a > (uintptr_t) b) - ((uintptr_t) a < (uintptr_t) b));
+}
+
+static int
+rb_bench_cmp (uintptr_t a, uintptr_t b)
+{
+    return ((a > b) - (a < b));
+}
+
+static void
+aa_bench_visit (void *cb, aa_node_t *node)
+{
+    *(uintptr_t *) cb += node->aa_data;
+}
+
+static void
+rb_bench_visit (void *cb, rb_node_t *node)
+{
+    *(uintptr_t *) cb += node->rbn_data;
+}
+
+static double
+bench_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+#define BENCH_REPORT(what, aa, rb)                                           \
+    printf ("%-14s %8.1f %8.1f ns/key\n", (what),                            \
+            (aa) / BENCH_N, (rb) / BENCH_N)
+
+int
+main (int argc, char **argv)
+{
+    static void *keys [BENCH_N];
+    static void *sorted [BENCH_N];
+    aa_tree_t   *aat;
+    rb_tree_t   *rbt;
+    aa_node_t   *an;
+    rb_node_t   *rn;
+    uintptr_t    sum = 0;
+    double       t0, ta, tr;
+    void        *swap;
+    uint32_t     i, j;
+
+    /* Distinct keys, shuffled */
+    srand (1);
+    for (i = 0; i < BENCH_N; ++i)
+        sorted [i] = keys [i] = (void*) ((uintptr_t) i * 7919);
+    for (i = BENCH_N - 1; i > 0; --i)
+    {
+        j        = rand () % (i + 1);
+        swap     = keys [i];
+        keys [i] = keys [j];
+        keys [j] = swap;
+    }
+
+    aa_new (&aat);
+    rb_new (&rbt);
+    printf ("%-14s %8s %8s\n", "", "aa", "rb");
+
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_N; ++i)
+        aa_insert (aat, keys [i], aa_bench_cmp, &an);
+    ta = bench_now () - t0;
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_N; ++i)
+        rb_insert (rbt, keys [i], rb_bench_cmp, &rn);
+    tr = bench_now () - t0;
+    BENCH_REPORT ("insert", ta, tr);
+
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_N; ++i)
+        aa_find (aat, keys [i], aa_bench_cmp, &an);
+    ta = bench_now () - t0;
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_N; ++i)
+        rb_find (rbt, keys [i], rb_bench_cmp, &rn);
+    tr = bench_now () - t0;
+    BENCH_REPORT ("find", ta, tr);
+
+    {
+        aa_frozen_t fz;
+        uint32_t    hits = 0;
+
+        aa_freeze (aat, &fz);
+        t0 = bench_now ();
+        for (i = 0; i < BENCH_N; ++i)
+            hits += (aa_frozen_find (&fz, keys [i], aa_bench_cmp) != 0);
+        ta = bench_now () - t0;
+        printf ("%-14s %8.1f %8s ns/key\n", "frozen find", ta / BENCH_N, "-");
+        sum += hits;
+        aa_frozen_free (&fz);
+    }
+
+    t0 = bench_now ();
+    aa_walk (aat, &sum, aa_bench_visit);
+    ta = bench_now () - t0;
+    t0 = bench_now ();
+    rb_walk (rbt, RB_TRAV_INORDER, &sum, rb_bench_visit);
+    tr = bench_now () - t0;
+    BENCH_REPORT ("walk", ta, tr);
+#ifdef AA_THREADED
+
+    t0 = bench_now ();
+    for (an = aa_first (aat); an != AA_NIL; an = aa_next (an))
+        sum += an->aa_data;
+    ta = bench_now () - t0;
+    printf ("%-14s %8.1f %8s ns/key\n", "thread walk", ta / BENCH_N, "-");
+#endif
+
+    printf ("%-14s %8d %8d\n", "height", aa_height (aat), rb_height (rbt));
+
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_N; ++i)
+        aa_remove (aat, keys [i], aa_bench_cmp);
+    ta = bench_now () - t0;
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_N; ++i)
+        rb_remove (rbt, keys [i], rb_bench_cmp);
+    tr = bench_now () - t0;
+    BENCH_REPORT ("remove", ta, tr);
+
+    t0 = bench_now ();
+    aa_build_sorted (aat, sorted, BENCH_N);
+    ta = bench_now () - t0;
+    t0 = bench_now ();
+    rb_build_sorted (rbt, sorted, BENCH_N);
+    tr = bench_now () - t0;
+    BENCH_REPORT ("build sorted", ta, tr);
+
+    t0 = bench_now ();
+    aa_delete (&aat, NULL);
+    ta = bench_now () - t0;
+    t0 = bench_now ();
+    rb_delete (&rbt, NULL);
+    tr = bench_now () - t0;
+    BENCH_REPORT ("delete", ta, tr);
+
+    return (sum == 0);
+}
 #endif
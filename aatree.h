@@ -32,26 +32,230 @@
 #define LEFT    0
 #define RIGHT   1
 
-#define LLINK(n)    (n)->aa_link[LEFT]
-#define RLINK(n)    (n)->aa_link[RIGHT]
 
+#ifndef RC_T_DEFINED_
+#define RC_T_DEFINED_
 typedef enum
 {
     ROK,
     RFAIL
 } rc_t;
+#endif
 
 
-typedef int             (*aa_cmp_t) (void *, void *);
+typedef int             (*aa_cmp_t)   (void *, void *);
+typedef void            (*aa_dtor_t)  (void *);
 
 typedef struct aa_node_ aa_node_t;
+typedef void            (*aa_visit_t) (void *, aa_node_t *);
 
+#if defined(AA_COMPACT_NODE) && defined(AA_THREADED)
+#error "AA_COMPACT_NODE leaves no link bit free for AA_THREADED"
+#endif
+
+/* Sentinel for absent children; the same as aa_nilp () */
+extern const aa_node_t aa_nil_node;
+
+#ifdef AA_COMPACT_NODE
+/*
+ * Three words (four with AA_AUGMENT), no padding: the level (at most
+ * log2 (n + 1), so below 64) is kept in the three low bits of each link,
+ * the low half in the left one. Nodes must be 8 byte aligned, which
+ * malloc and the attribute give.
+ */
+struct aa_node_
+{
+    uintptr_t  aa_lnk [2];
+    uintptr_t  aa_data;
+#ifdef AA_AUGMENT
+    uintptr_t  aa_agg;                  /* see aa_monoid_t                  */
+#endif
+} __attribute__ ((aligned (8)));
+
+#define AA_LVL_MASK             ((uintptr_t) 7)
+#define aa_child(n, d)          ((aa_node_t *) ((n)->aa_lnk[d] & ~AA_LVL_MASK))
+#define aa_lvl(n)               ((int) (((n)->aa_lnk[LEFT] & AA_LVL_MASK) |    \
+                                        (((n)->aa_lnk[RIGHT] & AA_LVL_MASK)    \
+                                         << 3)))
+#else
 struct aa_node_
 {
     aa_node_t *aa_link [2];
     uintptr_t  aa_data;
+#ifdef AA_AUGMENT
+    uintptr_t  aa_agg;                  /* see aa_monoid_t                  */
+#endif
     uint8_t    aa_level;
 };
 
+#ifdef AA_THREADED
+/*
+ * A right link a plain tree would leave empty points, tagged in its low
+ * bit, to the node's in-order successor instead (untagged AA_NIL after
+ * the last node). aa_child() still reports such a link as absent, so
+ * only aa_next() ever follows a thread.
+ */
+#define AA_THREAD_TAG           ((uintptr_t) 1)
+#define aa_threaded(n)          (((uintptr_t) (n)->aa_link[RIGHT] &            \
+                                  AA_THREAD_TAG) != 0)
+#define aa_child(n, d)          ((((d) == RIGHT) && aa_threaded (n)) ?         \
+                                    (aa_node_t *) &aa_nil_node :               \
+                                    (n)->aa_link[d])
+#else
+#define aa_child(n, d)          ((n)->aa_link[d])
+#endif
+#define aa_lvl(n)               ((int) (n)->aa_level)
+#endif
+
+#define LLINK(n)    aa_child ((n), LEFT)
+#define RLINK(n)    aa_child ((n), RIGHT)
+
+/*
+ * Range aggregates (AA_AUGMENT, aa_range_agg): each node keeps in aa_agg
+ * the combined am_value of every node in its subtree, in key order.
+ * am_combine must be associative with am_identity as its identity (a
+ * monoid: sum, min, max, ...); it need not be commutative.
+ */
+typedef struct aa_monoid_
+{
+    uintptr_t (*am_value)   (void *data);
+    uintptr_t (*am_combine) (uintptr_t a, uintptr_t b);
+    uintptr_t   am_identity;
+} aa_monoid_t;
+
+typedef struct aa_tree_
+{
+    aa_node_t *aat_root;
+    uint32_t   aat_cnt;
+#ifdef AA_AUGMENT
+    const aa_monoid_t *aat_mon;         /* NULL: no aggregates kept         */
+#endif
+} aa_tree_t;
+
+/* 
+ * The height of an AA tree is at most 2 log2 (n + 1), so this covers any
+ * tree with a 32 bit count.
+ */
+#define AA_MAX_HEIGHT   64
+
+/* In-order cursor: the ancestors still to be visited, current on top */
+typedef struct aa_iter_
+{
+    aa_node_t *ai_stack [AA_MAX_HEIGHT];
+    int        ai_top;
+} aa_iter_t;
+
+/*
+ * Read-only copy of a tree's keys (aa_freeze) in Eytzinger order: the
+ * root at index 1 and the children of k at 2k and 2k + 1, like a binary
+ * heap. No links are stored, and every search walks the same first few
+ * cache lines. Index 0 is unused and stands for "not found".
+ */
+typedef struct aa_frozen_
+{
+    uintptr_t *afz_keys;                /* [1 .. afz_cnt], 64 byte aligned  */
+    uint32_t   afz_cnt;
+} aa_frozen_t;
+
+#define aa_frozen_data(fz, i)   ((fz)->afz_keys [i])
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern aa_node_t* aa_nilp           (void);
+
+extern void       aa_new            (aa_tree_t  **treep);
+
+extern void       aa_delete         (aa_tree_t  **treep,
+                                     aa_dtor_t    dtor);
+
+extern void       aa_insert         (aa_tree_t   *tree,
+                                     void        *item,
+                                     aa_cmp_t     cmp,
+                                     aa_node_t  **nodep);
+
+extern void       aa_find           (aa_tree_t   *tree,
+                                     void        *item,
+                                     aa_cmp_t     cmp,
+                                     aa_node_t  **nodep);
+
+extern rc_t       aa_remove         (aa_tree_t   *tree,
+                                     void        *item,
+                                     aa_cmp_t     cmp);
+
+extern rc_t       aa_build_sorted   (aa_tree_t   *tree,
+                                     void       **items,
+                                     uint32_t     n);
+
+extern rc_t       aa_insert_batch   (aa_tree_t   *tree,
+                                     void       **items,
+                                     uint32_t     n,
+                                     aa_cmp_t     cmp);
+
+extern void       aa_walk           (aa_tree_t   *tree,
+                                     void        *cb,
+                                     aa_visit_t   visit);
+
+extern int        aa_height         (aa_tree_t   *tree);
+
+/* Cursors: AA_NIL (aa_nilp) once past the end */
+
+extern aa_node_t* aa_iter_first     (aa_tree_t   *tree,
+                                     aa_iter_t   *iter);
+
+extern aa_node_t* aa_iter_seek      (aa_tree_t   *tree,
+                                     aa_iter_t   *iter,
+                                     void        *item,
+                                     aa_cmp_t     cmp);
+
+extern aa_node_t* aa_iter_next      (aa_iter_t   *iter);
+
+#ifdef AA_AUGMENT
+extern void       aa_set_monoid     (aa_tree_t   *tree,
+                                     const aa_monoid_t *mon);
+
+extern uintptr_t  aa_range_agg      (aa_tree_t   *tree,
+                                     void        *lo,
+                                     void        *hi,
+                                     aa_cmp_t     cmp);
+#endif
+
+#ifdef AA_THREADED
+/* Stackless cursors over the threads; no state besides the node */
+
+extern aa_node_t* aa_first          (aa_tree_t   *tree);
+
+extern aa_node_t* aa_lower_bound    (aa_tree_t   *tree,
+                                     void        *item,
+                                     aa_cmp_t     cmp);
+
+extern aa_node_t* aa_next           (aa_node_t   *node);
+#endif
+
+/* Frozen copies: indices into afz_keys, 0 when there is none */
+
+extern rc_t       aa_freeze         (aa_tree_t   *tree,
+                                     aa_frozen_t *fz);
+
+extern void       aa_frozen_free    (aa_frozen_t *fz);
+
+extern uint32_t   aa_frozen_lower_bound (aa_frozen_t *fz,
+                                     void        *item,
+                                     aa_cmp_t     cmp);
+
+extern uint32_t   aa_frozen_find    (aa_frozen_t *fz,
+                                     void        *item,
+                                     aa_cmp_t     cmp);
+
+extern uint32_t   aa_frozen_first   (aa_frozen_t *fz);
+
+extern uint32_t   aa_frozen_next    (aa_frozen_t *fz,
+                                     uint32_t     i);
+
+#ifdef __cplusplus
+}
+#endif
+
 
 #endif /* AA_TREE_H_ */
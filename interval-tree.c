@@ -0,0 +1,307 @@
+/***************************************************************************
+ *     Copyright (C) [2012 - ] Harish Raghuveer - All Rights Reserved      *
+ *                                                                         *
+ *   THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF    *
+ *   ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO   *
+ *   THE IMPLIED WARRANTIES OF MECHANTABILITY AND/OR FITNESS FOR A         *
+ *   PARTICULAR PURPOSE.                                                   *
+ ***************************************************************************
+ ***************************************************************************
+ * @file    interval-tree.c                                                *
+ *                                                                         *
+ * @brief   Overlap and stabbing queries over closed intervals, on top of  *
+ *          the intrusive red-black tree. rbtree.c keeps itn_max exact     *
+ *          through rotations and both fixups via rb_set_augment(); this   *
+ *          file only supplies the augment function and the queries.       *
+ *                                                                         *
+ *          Test: cc -DETEST -c interval-tree.c && cc interval-tree.o      *
+ *          rbtree.c                                                       *
+ *                                                                         *
+ * @author  Harish Raghuveer                                               *
+ ***************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "rbtree.h"
+#include "interval-tree.h"
+
+/**************************************************************************
+ *                             Internal Functions                         *
+ **************************************************************************/
+
+#define IT_NODE(rbn)    rb_entry ((rbn), it_node_t, itn_rbn)
+
+static rb_node_t *it_nil;
+
+/* Order by low endpoint, then high; rbn_data points back at the node */
+static int
+it_cmp (uintptr_t a,
+        uintptr_t b)
+{
+    const it_node_t *x = (const it_node_t*) a;
+    const it_node_t *y = (const it_node_t*) b;
+
+    if (x->itn_lo != y->itn_lo)
+        return ((x->itn_lo < y->itn_lo) ? -1 : 1);
+    if (x->itn_hi != y->itn_hi)
+        return ((x->itn_hi < y->itn_hi) ? -1 : 1);
+    return (0);
+}
+
+static int
+it_augment (rb_node_t *rbn)
+{
+    it_node_t *node = IT_NODE (rbn);
+    uint64_t   max  = node->itn_hi;
+
+    if ((rbn->rbn_left != it_nil) &&
+        (IT_NODE (rbn->rbn_left)->itn_max > max))
+        max = IT_NODE (rbn->rbn_left)->itn_max;
+    if ((rbn->rbn_right != it_nil) &&
+        (IT_NODE (rbn->rbn_right)->itn_max > max))
+        max = IT_NODE (rbn->rbn_right)->itn_max;
+
+    if (node->itn_max == max)
+        return (0);
+    node->itn_max = max;
+    return (1);
+}
+
+/*
+ * Report the intervals below rbn that overlap [lo, hi], in order. A
+ * subtree whose itn_max is below lo holds nothing that reaches lo, and
+ * once a node starts after hi so does everything to its right; both are
+ * skipped whole.
+ */
+static uint32_t
+it_int_overlap (rb_node_t   *rbn,
+                uint64_t     lo,
+                uint64_t     hi,
+                it_visit_t   visit,
+                void        *cb,
+                int         *stopp)
+{
+    it_node_t *node;
+    uint32_t   cnt = 0;
+
+    while ((rbn != it_nil) && !*stopp)
+    {
+        node = IT_NODE (rbn);
+        if (node->itn_max < lo)
+            break;
+        cnt += it_int_overlap (rbn->rbn_left, lo, hi, visit, cb, stopp);
+        if (*stopp || (node->itn_lo > hi))
+            break;
+        if (node->itn_hi >= lo)
+        {
+            ++cnt;
+            if (visit && (*visit) (cb, node))
+                *stopp = 1;
+        }
+        rbn = rbn->rbn_right;
+    }
+    return (cnt);
+}
+
+/**************************************************************************
+ *                                 API                                    *
+ **************************************************************************/
+
+/**
+ * @brief
+ *
+ * @param tree
+ */
+void
+it_init (it_tree_t  *tree)
+{
+    it_nil = rb_nilp ();
+    rb_init_intrusive (&tree->itt_rbt);
+    rb_set_augment (&tree->itt_rbt, it_augment);
+}
+
+/**
+ * @brief Prepare a caller owned node for the closed interval [lo, hi].
+ *
+ * @param node
+ * @param lo
+ * @param hi    Must not be below lo
+ */
+void
+it_node_init (it_node_t  *node,
+              uint64_t    lo,
+              uint64_t    hi)
+{
+    rb_node_init (&node->itn_rbn, node);
+    node->itn_lo  = lo;
+    node->itn_hi  = hi;
+    node->itn_max = hi;
+}
+
+/**
+ * @brief O(log n); never allocates.
+ *
+ * @param tree
+ * @param node  Prepared with it_node_init()
+ */
+void
+it_insert (it_tree_t  *tree,
+           it_node_t  *node)
+{
+    rb_insert_node (&tree->itt_rbt, &node->itn_rbn, it_cmp);
+}
+
+/**
+ * @brief O(log n); the node is the caller's again afterwards.
+ *
+ * @param tree
+ * @param node
+ */
+void
+it_remove (it_tree_t  *tree,
+           it_node_t  *node)
+{
+    rb_remove_handle (&tree->itt_rbt, &node->itn_rbn, it_cmp);
+}
+
+/**
+ * @brief Some interval overlapping [lo, hi], NULL if none. O(log n).
+ *
+ * @param tree
+ * @param lo
+ * @param hi
+ */
+it_node_t*
+it_any_overlap (it_tree_t  *tree,
+                uint64_t    lo,
+                uint64_t    hi)
+{
+    rb_node_t *rbn = tree->itt_rbt.rb_root;
+    it_node_t *node;
+
+    while (rbn != it_nil)
+    {
+        node = IT_NODE (rbn);
+        if ((node->itn_lo <= hi) && (node->itn_hi >= lo))
+            return (node);
+        /* If the left subtree reaches lo but misses, so does the right */
+        if ((rbn->rbn_left != it_nil) &&
+            (IT_NODE (rbn->rbn_left)->itn_max >= lo))
+            rbn = rbn->rbn_left;
+        else
+            rbn = rbn->rbn_right;
+    }
+    return (NULL);
+}
+
+/**
+ * @brief Call visit on every interval overlapping [lo, hi], in order of
+ *        low endpoint, until it returns nonzero. Nothing is allocated;
+ *        the walk recurses no deeper than the tree is tall. Subtrees that
+ *        cannot hold an answer are skipped whole, so reporting k
+ *        intervals costs O(k log n), and O(log n) when there are none.
+ *
+ * @param tree
+ * @param lo
+ * @param hi
+ * @param visit May be NULL, to just count
+ * @param cb    Passed through to visit
+ *
+ * @return The number of intervals reported.
+ */
+uint32_t
+it_overlap (it_tree_t   *tree,
+            uint64_t     lo,
+            uint64_t     hi,
+            it_visit_t   visit,
+            void        *cb)
+{
+    int stop = 0;
+
+    return (it_int_overlap (tree->itt_rbt.rb_root, lo, hi, visit, cb, &stop));
+}
+
+/**
+ * @brief it_overlap() for the single point [point, point].
+ *
+ * @param tree
+ * @param point
+ * @param visit
+ * @param cb
+ */
+uint32_t
+it_stab (it_tree_t   *tree,
+         uint64_t     point,
+         it_visit_t   visit,
+         void        *cb)
+{
+    return (it_overlap (tree, point, point, visit, cb));
+}
+
+#ifdef ETEST
+
+#define IT_TEST_N   20000
+
+static it_node_t nodes [IT_TEST_N];
+static char      live  [IT_TEST_N];
+
+static int
+count_visit (void *cb, it_node_t *node)
+{
+    uint64_t *lastp = cb;
+
+    /* Reported in order of low endpoint */
+    if (node->itn_lo < *lastp)
+        printf ("out of order!\n");
+    *lastp = node->itn_lo;
+    return (0);
+}
+
+int
+main (int argc, char **argv)
+{
+    it_tree_t  tree;
+    uint64_t   lo, hi, last;
+    uint32_t   cnt, want;
+    int        i, j;
+
+    it_init (&tree);
+    srand (1);
+    for (i = 0; i < IT_TEST_N; ++i)
+    {
+        lo = rand () % 1000000;
+        it_node_init (&nodes [i], lo, lo + rand () % (1 + (i % 7) * 500));
+        it_insert (&tree, &nodes [i]);
+        live [i] = 1;
+    }
+    for (i = 0; i < IT_TEST_N; i += 3)
+    {
+        it_remove (&tree, &nodes [i]);
+        live [i] = 0;
+    }
+
+    for (j = 0; j < 200; ++j)
+    {
+        lo   = rand () % 1000000;
+        hi   = lo + (j % 4) * 100;
+        last = 0;
+        cnt  = it_overlap (&tree, lo, hi, count_visit, &last);
+        for (want = 0, i = 0; i < IT_TEST_N; ++i)
+            if (live [i] && (nodes [i].itn_lo <= hi) && (nodes [i].itn_hi >= lo))
+                ++want;
+        if (cnt != want)
+            printf ("[%lu, %lu]: %u overlaps, expected %u\n",
+                    (unsigned long) lo, (unsigned long) hi, cnt, want);
+        if ((it_any_overlap (&tree, lo, hi) == NULL) != (want == 0))
+            printf ("it_any_overlap wrong for [%lu, %lu]\n",
+                    (unsigned long) lo, (unsigned long) hi);
+    }
+    printf ("%u intervals, height %d, %u cover 500000\n",
+            tree.itt_rbt.rb_cnt, rb_height (&tree.itt_rbt),
+            it_stab (&tree, 500000, NULL, NULL));
+    return 0;
+}
+#endif
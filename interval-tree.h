@@ -0,0 +1,74 @@
+/***************************************************************************
+ *     Copyright (C) [2012 - ] Harish Raghuveer - All Rights Reserved      *
+ *                                                                         *
+ *   THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF    *
+ *   ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO   *
+ *   THE IMPLIED WARRANTIES OF MECHANTABILITY AND/OR FITNESS FOR A         *
+ *   PARTICULAR PURPOSE.                                                   *
+ ***************************************************************************
+ ***************************************************************************
+ * @file    interval-tree.h                                                *
+ *                                                                         *
+ * @brief   Interval tree: an intrusive red-black tree ordered by low      *
+ *          endpoint, each node augmented with the largest high endpoint   *
+ *          in its subtree. Include stdint.h and rbtree.h first.           *
+ *                                                                         *
+ * @author  Harish Raghuveer                                               *
+ ***************************************************************************/
+
+#ifndef INTERVAL_TREE_H_
+#define INTERVAL_TREE_H_
+
+/* Closed interval [itn_lo, itn_hi]; embed it in the caller's object */
+typedef struct it_node_
+{
+    rb_node_t   itn_rbn;
+    uint64_t    itn_lo;
+    uint64_t    itn_hi;
+    uint64_t    itn_max;                /* max itn_hi in this subtree       */
+} it_node_t;
+
+typedef struct it_tree_
+{
+    rb_tree_t   itt_rbt;                /* intrusive, augmented             */
+} it_tree_t;
+
+/* Called per overlapping interval; return nonzero to stop the query */
+typedef int (*it_visit_t) (void*, it_node_t*);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void       it_init           (it_tree_t   *tree);
+
+extern void       it_node_init      (it_node_t   *node,
+                                     uint64_t     lo,
+                                     uint64_t     hi);
+
+extern void       it_insert         (it_tree_t   *tree,
+                                     it_node_t   *node);
+
+extern void       it_remove         (it_tree_t   *tree,
+                                     it_node_t   *node);
+
+extern it_node_t* it_any_overlap    (it_tree_t   *tree,
+                                     uint64_t     lo,
+                                     uint64_t     hi);
+
+extern uint32_t   it_overlap        (it_tree_t   *tree,
+                                     uint64_t     lo,
+                                     uint64_t     hi,
+                                     it_visit_t   visit,
+                                     void        *cb);
+
+extern uint32_t   it_stab           (it_tree_t   *tree,
+                                     uint64_t     point,
+                                     it_visit_t   visit,
+                                     void        *cb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INTERVAL_TREE_H_ */
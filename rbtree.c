@@ -17,9 +17,18 @@
  ***************************************************************************/
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef RB_CONCURRENT
+#include <pthread.h>
+#endif
 
 #include "rbtree.h"
 
@@ -33,42 +42,140 @@ rb_nil_node =
     (uintptr_t) NULL,
     (rb_node_t*) &rb_nil_node,
     (rb_node_t*) &rb_nil_node,
+#ifdef RB_PACKED_COLOR
+    (uintptr_t) &rb_nil_node            /* red bit clear: RB_BLACK */
+#else
     (rb_node_t*) &rb_nil_node,
     RB_BLACK
+#endif
 };
 static rb_node_t *RB_NIL = (rb_node_t*)&rb_nil_node;
 
+#ifdef RB_ORDER_STAT
+#define RB_SIZE_SET(n, sz)  ((n)->rbn_size = (sz))
+#define RB_SIZE_FIX(n)      ((n)->rbn_size = (n)->rbn_left->rbn_size + \
+                                             (n)->rbn_right->rbn_size + 1)
+#else
+#define RB_SIZE_SET(n, sz)  ((void) 0)
+#define RB_SIZE_FIX(n)      ((void) 0)
+#endif
+
+#ifdef RB_SNAPSHOT
+#define RB_REF_SET(n, r)    ((n)->rbn_ref = (r))
+#define RB_SNAPS(tree)      __atomic_load_n (&(tree)->rb_snaps, __ATOMIC_ACQUIRE)
+#define RB_COW(tree, n)     rb_cow ((tree), (n))
+#else
+#define RB_REF_SET(n, r)    ((void) 0)
+#define RB_SNAPS(tree)      0
+#define RB_COW(tree, n)     (n)
+#endif
+
+/* Adjust the subtree size of every node from 'node' up to the root */
+static inline void
+rb_size_add_path (rb_node_t  *node,
+                  int64_t     delta)
+{
+#ifdef RB_ORDER_STAT
+    for (; node != RB_NIL; node = rb_paren (node))
+        node->rbn_size += delta;
+#else
+    (void) node;
+    (void) delta;
+#endif
+}
+
 static inline void
 rb_transplant (rb_node_t **root,
                rb_node_t  *u,
                rb_node_t  *v)
 {
-    if (u->rbn_paren == RB_NIL)
+    if (rb_paren (u) == RB_NIL)
         *root = v;
-    else if (u == u->rbn_paren->rbn_left)
-        u->rbn_paren->rbn_left = v;
+    else if (u == rb_paren (u)->rbn_left)
+        rb_paren (u)->rbn_left = v;
     else
-        u->rbn_paren->rbn_right = v;
-    if (v != RB_NIL)
-        v->rbn_paren = u->rbn_paren;
+        rb_paren (u)->rbn_right = v;
+    /* Also done for RB_NIL: rb_remove_fixup may start at the sentinel. */
+    rb_set_paren (v, rb_paren (u));
+}
+
+
+static rb_node_t*
+rb_slab_alloc (rb_tree_t *tree)
+{
+    rb_slab_t *slab;
+    rb_node_t *node;
+
+    node = tree->rb_free;
+    if (node != RB_NIL)
+    {
+        tree->rb_free = node->rbn_right;
+        return (node);
+    }
+
+    slab = tree->rb_slabs;
+    if ((slab == NULL) ||
+        (slab->rbs_used == slab->rbs_cnt))
+    {
+        slab = malloc (sizeof(*slab) + 
+                       tree->rb_slab_nodes * sizeof(rb_node_t));
+        if (slab == NULL)
+            return (NULL);
+        slab->rbs_cnt  = tree->rb_slab_nodes;
+        slab->rbs_used = 0;
+        slab->rbs_next = tree->rb_slabs;
+        tree->rb_slabs = slab;
+    }
+    return (&slab->rbs_nodes [slab->rbs_used++]);
 }
 
+static void
+rb_slab_release (rb_tree_t *tree)
+{
+    rb_slab_t *slab;
+    rb_slab_t *next;
+
+    for (slab = tree->rb_slabs; slab != NULL; slab = next)
+    {
+        next = slab->rbs_next;
+        free (slab);
+    }
+    tree->rb_slabs = NULL;
+    tree->rb_free  = RB_NIL;
+}
 
 static inline void
-rbn_new (rb_node_t **nodep, 
+rbn_new (rb_tree_t  *tree,
+         rb_node_t **nodep, 
          uintptr_t   data)
 {
     rb_node_t *node;
 
-    node = calloc (1, sizeof(*node));
-    assert (node);
+    switch (tree->rb_alloc)
+    {
+    case RB_ALLOC_SLAB:
+        node = rb_slab_alloc (tree);
+        assert (node);
+        break;
+
+    case RB_ALLOC_HEAP:
+        node = calloc (1, sizeof(*node));
+        assert (node);
+        break;
+
+    default:
+        node = NULL;                    /* intrusive trees never allocate */
+        break;
+    }
     if (node)
     {
         node->rbn_left  = RB_NIL;
         node->rbn_right = RB_NIL;
-        node->rbn_paren = RB_NIL;
+        rb_set_paren (node, RB_NIL);
         node->rbn_data  = data;
-        node->rbn_color = RB_RED;
+        rb_set_color (node, RB_RED);
+        RB_SIZE_SET (node, 1);
+        RB_REF_SET (node, 1);
     }
     *nodep = node;
 }
@@ -92,6 +199,157 @@ rbn_delete (void       *dtor,
     return;
 }
 
+/* Visitor used on slab trees: only the data goes, slabs are freed later. */
+static inline void
+rbn_dtor (void       *dtor,
+          rb_node_t  *node)
+{
+    rb_dtor_t func = dtor;
+
+    (*func) (node->rbn_data);
+}
+
+static inline void
+rbn_free (rb_tree_t  *tree,
+          rb_node_t  *node)
+{
+    switch (tree->rb_alloc)
+    {
+    case RB_ALLOC_SLAB:
+        /* The list ends in RB_NIL: lock-free readers may still follow it */
+        node->rbn_right = tree->rb_free;
+        tree->rb_free   = node;
+        break;
+
+    case RB_ALLOC_HEAP:
+        rbn_delete (NULL, node);
+        break;
+
+    default:
+        /* Intrusive: the node belongs to the caller, just unhook it */
+        node->rbn_left  = RB_NIL;
+        node->rbn_right = RB_NIL;
+        rb_set_paren (node, RB_NIL);
+        break;
+    }
+}
+
+/*
+ * Free every node of the subtree at node, in key order, with constant
+ * stack and no parent pointers: while the top node has a left child,
+ * rotate it up; once it has none, free it and carry on with its right.
+ * Each rotation puts one node for good on a right spine, so there are
+ * fewer than n of them and every node is touched O(1) times.
+ */
+static uint32_t
+rb_int_destroy (rb_tree_t  *tree,
+                rb_node_t  *node,
+                rb_dtor_t   dtor)
+{
+    rb_node_t *left;
+    rb_node_t *next;
+    uint32_t   cnt = 0;
+
+    while (node != RB_NIL)
+    {
+        left = node->rbn_left;
+        if (left != RB_NIL)
+        {
+            node->rbn_left  = left->rbn_right;
+            left->rbn_right = node;
+            node            = left;
+            continue;
+        }
+        next = node->rbn_right;
+        if (dtor)
+            (*dtor) (node->rbn_data);
+        rbn_free (tree, node);
+        node = next;
+        ++cnt;
+    }
+    return (cnt);
+}
+
+#ifdef RB_SNAPSHOT
+/*
+ * Snapshots share nodes with the live tree; rbn_ref counts the child (or
+ * root) links to a node from every version. A live node is the tree's own
+ * only if it and all its ancestors have a count of one, and only such
+ * nodes may have their links or data changed. Parent pointers, colours
+ * and subtree sizes are for the live tree alone: snapshots never read
+ * them, so writers keep updating them on shared nodes.
+ *
+ * Counts only go up under the writer; a snapshot may be released from any
+ * thread, hence the atomics.
+ */
+
+/* Drop one link to node, freeing what no version reaches any more */
+static void
+rb_node_unref (rb_node_t  *node)
+{
+    rb_node_t *next;
+
+    while ((node != RB_NIL) &&
+           (__atomic_sub_fetch (&node->rbn_ref, 1, __ATOMIC_ACQ_REL) == 0))
+    {
+        rb_node_unref (node->rbn_left);
+        next = node->rbn_right;
+        free (node);
+        node = next;
+    }
+}
+
+static inline void
+rb_node_ref (rb_node_t  *node)
+{
+    if (node != RB_NIL)
+        __atomic_add_fetch (&node->rbn_ref, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Make live node n the tree's own, copying it and any shared ancestors,
+ * and return what now stands in its place. Callers must use the returned
+ * node; n itself may only be reachable from snapshots afterwards.
+ */
+static rb_node_t*
+rb_cow (rb_tree_t  *tree,
+        rb_node_t  *n)
+{
+    rb_node_t *paren;
+    rb_node_t *c;
+
+    if ((n == RB_NIL) || (RB_SNAPS (tree) == 0))
+        return (n);
+
+    paren = rb_paren (n);
+    if (paren != RB_NIL)
+        paren = rb_cow (tree, paren);
+    if (__atomic_load_n (&n->rbn_ref, __ATOMIC_ACQUIRE) == 1)
+        return (n);
+
+    c = malloc (sizeof(*c));
+    assert (c);
+    *c         = *n;                    /* data, links, colour, size */
+    c->rbn_ref = 1;
+    rb_set_paren (c, paren);
+    rb_node_ref (c->rbn_left);
+    rb_node_ref (c->rbn_right);
+    if (c->rbn_left != RB_NIL)
+        rb_set_paren (c->rbn_left, c);
+    if (c->rbn_right != RB_NIL)
+        rb_set_paren (c->rbn_right, c);
+
+    if (paren == RB_NIL)
+        tree->rb_root = c;
+    else if (paren->rbn_left == n)
+        paren->rbn_left = c;
+    else
+        paren->rbn_right = c;
+    rb_node_unref (n);
+    return (c);
+}
+#endif /* RB_SNAPSHOT */
+
 static inline void
 rb_int_init (rb_node_t **rootp)
 {
@@ -99,8 +357,9 @@ rb_int_init (rb_node_t **rootp)
 }
 
 static inline void
-rb_rotate_l (rb_node_t **root, 
-             rb_node_t  *x)
+rb_rotate_l (rb_node_t    **root, 
+             rb_node_t     *x,
+             rb_augment_t   aug)
 {
     rb_node_t  *y;
 
@@ -109,25 +368,34 @@ rb_rotate_l (rb_node_t **root,
                                         * right subtree */
     if (y->rbn_left != RB_NIL)
     {
-        y->rbn_left->rbn_paren = x;
+        rb_set_paren (y->rbn_left, x);
     }
 
-    y->rbn_paren = x->rbn_paren;       /* link x's parent to y's */
+    rb_set_paren (y, rb_paren (x));    /* link x's parent to y's */
 
-    if (x->rbn_paren == RB_NIL)
+    if (rb_paren (x) == RB_NIL)
         *root = y;
-    else if (x == x->rbn_paren->rbn_left)
-        x->rbn_paren->rbn_left = y;
+    else if (x == rb_paren (x)->rbn_left)
+        rb_paren (x)->rbn_left = y;
     else
-        x->rbn_paren->rbn_right = y;
+        rb_paren (x)->rbn_right = y;
 
     y->rbn_left  = x;
-    x->rbn_paren = y;
+    rb_set_paren (x, y);
+
+    RB_SIZE_SET (y, x->rbn_size);
+    RB_SIZE_FIX (x);
+    if (aug)
+    {
+        (void) (*aug) (x);
+        (void) (*aug) (y);
+    }
 }
 
 static inline void
-rb_rotate_r (rb_node_t **root, 
-             rb_node_t  *y)
+rb_rotate_r (rb_node_t    **root, 
+             rb_node_t     *y,
+             rb_augment_t   aug)
 {
     rb_node_t  *x;
 
@@ -136,20 +404,28 @@ rb_rotate_r (rb_node_t **root,
 
     if (x->rbn_right != RB_NIL)
     {
-        x->rbn_right->rbn_paren = y;
+        rb_set_paren (x->rbn_right, y);
     }
 
-    x->rbn_paren = y->rbn_paren;       
+    rb_set_paren (x, rb_paren (y));
 
-    if (y->rbn_paren == RB_NIL)
+    if (rb_paren (y) == RB_NIL)
         *root = x;
-    else if (y == y->rbn_paren->rbn_right)
-        y->rbn_paren->rbn_right = x;
+    else if (y == rb_paren (y)->rbn_right)
+        rb_paren (y)->rbn_right = x;
     else
-        y->rbn_paren->rbn_left = x;
+        rb_paren (y)->rbn_left = x;
 
     x->rbn_right = y;
-    y->rbn_paren = x;
+    rb_set_paren (y, x);
+
+    RB_SIZE_SET (x, y->rbn_size);
+    RB_SIZE_FIX (y);
+    if (aug)
+    {
+        (void) (*aug) (y);
+        (void) (*aug) (x);
+    }
 }
 
 static inline void
@@ -179,29 +455,30 @@ rb_max (rb_node_t  *root,
 }
 
 
-static void
-rb_insert_fixup (rb_node_t **rootp, 
-                 rb_node_t  *z,
-                 rb_cmp_t    cmp)
+/* Returns 1 if the root had to be turned black, i.e. black height grew */
+static int
+rb_insert_fixup (rb_node_t    **rootp, 
+                 rb_node_t     *z,
+                 rb_augment_t   aug)
 {
     rb_node_t *paren;
     rb_node_t *uncle;
     rb_node_t *grand_paren;
 
-    while (/* (z->rbn_paren != RB_NIL) && */
-           (z->rbn_paren->rbn_color == RB_RED))
+    while (/* (rb_paren (z) != RB_NIL) && */
+           (rb_color (rb_paren (z)) == RB_RED))
     {
-        paren       = z->rbn_paren;
-        grand_paren = paren->rbn_paren;
+        paren       = rb_paren (z);
+        grand_paren = rb_paren (paren);
 
         if (paren == grand_paren->rbn_left)
         {
             uncle = grand_paren->rbn_right;
-            if (uncle->rbn_color == RB_RED)
+            if (rb_color (uncle) == RB_RED)
             {
-                paren->rbn_color       = RB_BLACK;
-                uncle->rbn_color       = RB_BLACK;
-                grand_paren->rbn_color = RB_RED;
+                rb_set_color (paren, RB_BLACK);
+                rb_set_color (uncle, RB_BLACK);
+                rb_set_color (grand_paren, RB_RED);
                 z                      = grand_paren;
             }
             else
@@ -209,21 +486,22 @@ rb_insert_fixup (rb_node_t **rootp,
                 if (z == paren->rbn_right)
                 {
                     z = paren;
-                    rb_rotate_l (rootp, z);
+                    rb_rotate_l (rootp, z, aug);
+                    paren = rb_paren (z);
                 }
-                paren->rbn_color       = RB_BLACK;
-                grand_paren->rbn_color = RB_RED;
-                rb_rotate_r (rootp, grand_paren);
+                rb_set_color (paren, RB_BLACK);
+                rb_set_color (grand_paren, RB_RED);
+                rb_rotate_r (rootp, grand_paren, aug);
             }
         }
         else
         {
             uncle = grand_paren->rbn_left;
-            if (uncle->rbn_color == RB_RED)
+            if (rb_color (uncle) == RB_RED)
             {
-                paren->rbn_color       = RB_BLACK;
-                uncle->rbn_color       = RB_BLACK;
-                grand_paren->rbn_color = RB_RED;
+                rb_set_color (paren, RB_BLACK);
+                rb_set_color (uncle, RB_BLACK);
+                rb_set_color (grand_paren, RB_RED);
                 z                      = grand_paren;
             }
             else
@@ -231,42 +509,91 @@ rb_insert_fixup (rb_node_t **rootp,
                 if (z == paren->rbn_left)
                 {
                     z = paren;
-                    rb_rotate_r (rootp, z);
+                    rb_rotate_r (rootp, z, aug);
+                    paren = rb_paren (z);
                 }
-                paren->rbn_color       = RB_BLACK;
-                grand_paren->rbn_color = RB_RED;
-                rb_rotate_l (rootp, grand_paren);
+                rb_set_color (paren, RB_BLACK);
+                rb_set_color (grand_paren, RB_RED);
+                rb_rotate_l (rootp, grand_paren, aug);
             }
         } 
     }
-    if (*rootp != RB_NIL)
-        (*rootp)->rbn_color = RB_BLACK;
+    if ((*rootp != RB_NIL) &&
+        (rb_color (*rootp) == RB_RED))
+    {
+        rb_set_color (*rootp, RB_BLACK);
+        return (1);
+    }
+    return (0);
 }
 
-static rc_t
-rb_int_insert (rb_node_t **root,
-               void       *data,
-               rb_cmp_t    cmp,
-               rb_node_t **node)
+/*
+ * Recompute the augmented value of node and its ancestors; with 'early',
+ * stop at the first one that reports no change.
+ */
+static inline void
+rb_aug_path (rb_node_t     *node,
+             rb_augment_t   aug,
+             int            early)
 {
-    rb_node_t *x;
-    rb_node_t *y;
-    rb_node_t *z;
-    int        rc;
+    for (; node != RB_NIL; node = rb_paren (node))
+        if (!(*aug) (node) && early)
+            break;
+}
 
-    rbn_new (&z, (uintptr_t) data);
-    if (NULL == z) 
+/* Hang z off y's empty side rc (y is RB_NIL for an empty tree), rebalance */
+static inline void
+rb_int_attach (rb_node_t    **root,
+               rb_node_t     *y,
+               int            rc,
+               rb_node_t     *z,
+               rb_augment_t   aug)
+{
+    rb_set_paren (z, y);
+    if (y == RB_NIL)
+        *root = z;
+    else if (rc < 0)
+        y->rbn_left = z;
+    else
+        y->rbn_right = z;
+
+    if (aug)
     {
-        *node = RB_NIL;
-        return (RFAIL);
+        (void) (*aug) (z);
+        rb_aug_path (y, aug, 1);
     }
+    rb_insert_fixup (root, 
+                     z,
+                     aug);
+}
+
+/*
+ * Link z below x, which must be a subtree z's key belongs in (the root, or
+ * a finger found by the caller), and rebalance.
+ */
+static void
+rb_int_link_from (rb_tree_t  *tree,
+                  rb_node_t  *x,
+                  rb_node_t  *z,
+                  rb_cmp_t    cmp)
+{
+    rb_node_t **root = &tree->rb_root;
+    rb_node_t  *y;
+    int         rc;
 
-    y = RB_NIL;
-    x = *root;
+    y  = RB_NIL;
+    rc = 0;
+    if (x != *root)
+    {
+        y = rb_paren (x);
+        rb_size_add_path (y, 1);
+        rc = (x == y->rbn_left) ? -1 : 1;
+    }
 
     while (x != RB_NIL)
     {
         y = x;
+        RB_SIZE_SET (x, x->rbn_size + 1);
         rc = (*cmp)(z->rbn_data, 
                     x->rbn_data);
         if (rc < 0)
@@ -274,127 +601,253 @@ rb_int_insert (rb_node_t **root,
         else
             x = x->rbn_right;
     }
-    z->rbn_paren = y;
-    rc = (*cmp)(z->rbn_data, 
-                y->rbn_data);
-    if (y == RB_NIL)
-        *root = z;
-    else if (rc < 0)
-        y->rbn_left = z;
-    else
-        y->rbn_right = z;
+    y = RB_COW (tree, y);
+    rb_int_attach (root, y, rc, z, tree->rb_aug);
+}
 
-    rb_insert_fixup (root, 
-                     z,
-                     cmp);
+static inline void
+rb_int_link (rb_tree_t  *tree,
+             rb_node_t  *z,
+             rb_cmp_t    cmp)
+{
+    rb_int_link_from (tree, tree->rb_root, z, cmp);
+}
+
+static rc_t
+rb_int_insert (rb_tree_t  *tree,
+               void       *data,
+               rb_cmp_t    cmp,
+               rb_node_t **node)
+{
+    rb_node_t *z;
+
+    rbn_new (tree, &z, (uintptr_t) data);
+    if (NULL == z) 
+    {
+        *node = RB_NIL;
+        return (RFAIL);
+    }
+
+    rb_int_link (tree, z, cmp);
     *node = z;
     return (ROK);
 }
 
+/*
+ * Link nodes [lo, hi] (already in key order) into a perfectly balanced
+ * subtree. Splitting at the midpoint keeps every missing child within the
+ * last two levels, so colouring just the deepest level red gives every
+ * path the same black height. Nodes are taken from vec when given, else
+ * from the contiguous array nodes.
+ */
+static rb_node_t*
+rb_int_build (rb_node_t  *nodes,
+              rb_node_t **vec,
+              int64_t     lo,
+              int64_t     hi,
+              rb_node_t  *paren,
+              int         depth,
+              int         red_depth)
+{
+    rb_node_t *node;
+    int64_t    mid;
+
+    if (lo > hi)
+        return (RB_NIL);
+
+    mid             = lo + (hi - lo) / 2;
+    node            = (vec) ? vec [mid] : &nodes [mid];
+    rb_set_paren (node, paren);
+    rb_set_color (node, (depth == red_depth) ? RB_RED : RB_BLACK);
+    RB_SIZE_SET (node, hi - lo + 1);
+    node->rbn_left  = rb_int_build (nodes, vec, lo, mid - 1, 
+                                    node, depth + 1, red_depth);
+    node->rbn_right = rb_int_build (nodes, vec, mid + 1, hi, 
+                                    node, depth + 1, red_depth);
+    return (node);
+}
+
+/* Make the n nodes (see rb_int_build) the whole tree */
+static void
+rb_int_rebuild (rb_tree_t  *tree,
+                rb_node_t  *nodes,
+                rb_node_t **vec,
+                uint32_t    n)
+{
+    int height;
+
+    for (height = 0; (n >> height) != 0; ++height)
+        ;
+    tree->rb_root = rb_int_build (nodes, vec, 0, (int64_t) n - 1, RB_NIL,
+                                  0, 
+                                  /* perfect trees are all black */
+                                  ((n & (n + 1)) == 0) ? -1 : height - 1);
+    tree->rb_cnt  = n;
+}
+
+/* Stable bottom-up merge sort of n items; tmp has room for n */
+static void
+rb_sort (void      **items,
+         void      **tmp,
+         uint32_t    n,
+         rb_cmp_t    cmp)
+{
+    void     **src = items;
+    void     **dst = tmp;
+    void     **swap;
+    uint32_t   width;
+    uint32_t   lo, mid, hi;
+    uint32_t   i, j, k;
+
+    for (width = 1; width < n; width *= 2)
+    {
+        for (lo = 0; lo < n; lo += 2 * width)
+        {
+            mid = (lo + width < n)     ? lo + width     : n;
+            hi  = (lo + 2 * width < n) ? lo + 2 * width : n;
+            for (i = lo, j = mid, k = lo; k < hi; ++k)
+            {
+                if ((i < mid) &&
+                    ((j == hi) ||
+                     ((*cmp)((uintptr_t) src [j], (uintptr_t) src [i]) >= 0)))
+                    dst [k] = src [i++];
+                else
+                    dst [k] = src [j++];
+            }
+        }
+        swap = src;
+        src  = dst;
+        dst  = swap;
+    }
+    if (src != items)
+        for (i = 0; i < n; ++i)
+            items [i] = src [i];
+}
+
 static void
-rb_remove_fixup (rb_node_t **rootp,
+rb_remove_fixup (rb_tree_t  *tree,
                  rb_node_t  *x,
                  rb_cmp_t    cmp)
 {
-    rb_node_t *sibling;
+    rb_node_t **rootp = &tree->rb_root;
+    rb_node_t  *sibling;
 
     while ((x            != *rootp) &&
-           (x->rbn_color == RB_BLACK))
+           (rb_color (x) == RB_BLACK))
     {
-        if (x == x->rbn_paren->rbn_left)
+        if (x == rb_paren (x)->rbn_left)
         {
-            sibling = x->rbn_paren->rbn_right;
+            sibling = rb_paren (x)->rbn_right;
 
-            if (sibling->rbn_color == RB_RED)
+            if (rb_color (sibling) == RB_RED)
             {
-                sibling->rbn_color      = RB_BLACK;
-                x->rbn_paren->rbn_color = RB_RED;
+                sibling = RB_COW (tree, sibling);
+                rb_set_color (sibling, RB_BLACK);
+                rb_set_color (rb_paren (x), RB_RED);
                 rb_rotate_l (rootp, 
-                             x->rbn_paren);
-                sibling                 = x->rbn_paren->rbn_right;
+                             rb_paren (x),
+                             tree->rb_aug);
+                sibling                 = rb_paren (x)->rbn_right;
             }
 
-            if ((sibling->rbn_left->rbn_color  == RB_BLACK) &&
-                (sibling->rbn_right->rbn_color == RB_BLACK))
+            if ((rb_color (sibling->rbn_left)  == RB_BLACK) &&
+                (rb_color (sibling->rbn_right) == RB_BLACK))
             {
-                sibling->rbn_color = RB_RED;
-                x                  = x->rbn_paren;
+                rb_set_color (sibling, RB_RED);
+                x                  = rb_paren (x);
             }
             else
             {
-                if (sibling->rbn_right->rbn_color == RB_BLACK)
+                if (rb_color (sibling->rbn_right) == RB_BLACK)
                 {
-                    sibling->rbn_left->rbn_color = RB_BLACK;
-                    sibling->rbn_color           = RB_RED;
+                    sibling = RB_COW (tree, sibling);
+                    (void) RB_COW (tree, sibling->rbn_left);
+                    rb_set_color (sibling->rbn_left, RB_BLACK);
+                    rb_set_color (sibling, RB_RED);
                     rb_rotate_r (rootp, 
-                                 sibling);
-                    sibling                      = x->rbn_paren->rbn_right;
+                                 sibling,
+                                 tree->rb_aug);
+                    sibling                      = rb_paren (x)->rbn_right;
                 }
 
-                sibling->rbn_color            = x->rbn_paren->rbn_color;
-                x->rbn_paren->rbn_color       = RB_BLACK;
-                sibling->rbn_right->rbn_color = RB_BLACK;
+                sibling = RB_COW (tree, sibling);
+                rb_set_color (sibling, rb_color (rb_paren (x)));
+                rb_set_color (rb_paren (x), RB_BLACK);
+                rb_set_color (sibling->rbn_right, RB_BLACK);
                 rb_rotate_l (rootp, 
-                             x->rbn_paren);
+                             rb_paren (x),
+                             tree->rb_aug);
                 x                             = *rootp;
             }
         }
         else
         {
-            sibling = x->rbn_paren->rbn_left;
+            sibling = rb_paren (x)->rbn_left;
 
-            if (sibling->rbn_color == RB_RED)
+            if (rb_color (sibling) == RB_RED)
             {
-                sibling->rbn_color      = RB_BLACK;
-                x->rbn_paren->rbn_color = RB_RED;
+                sibling = RB_COW (tree, sibling);
+                rb_set_color (sibling, RB_BLACK);
+                rb_set_color (rb_paren (x), RB_RED);
                 rb_rotate_r (rootp, 
-                             x->rbn_paren);
-                sibling                 = x->rbn_paren->rbn_left;
+                             rb_paren (x),
+                             tree->rb_aug);
+                sibling                 = rb_paren (x)->rbn_left;
             }
 
-            if ((sibling->rbn_left->rbn_color  == RB_BLACK) &&
-                (sibling->rbn_right->rbn_color == RB_BLACK))
+            if ((rb_color (sibling->rbn_left)  == RB_BLACK) &&
+                (rb_color (sibling->rbn_right) == RB_BLACK))
             {
-                sibling->rbn_color = RB_RED;
-                x                  = x->rbn_paren;
+                rb_set_color (sibling, RB_RED);
+                x                  = rb_paren (x);
             }
             else
             {
-                if (sibling->rbn_left->rbn_color == RB_BLACK)
+                if (rb_color (sibling->rbn_left) == RB_BLACK)
                 {
-                    sibling->rbn_right->rbn_color = RB_BLACK;
-                    sibling->rbn_color            = RB_RED;
+                    sibling = RB_COW (tree, sibling);
+                    (void) RB_COW (tree, sibling->rbn_right);
+                    rb_set_color (sibling->rbn_right, RB_BLACK);
+                    rb_set_color (sibling, RB_RED);
                     rb_rotate_l (rootp, 
-                                 sibling);
-                    sibling                       = x->rbn_paren->rbn_left;
+                                 sibling,
+                                 tree->rb_aug);
+                    sibling                       = rb_paren (x)->rbn_left;
                 }
 
-                sibling->rbn_color           = x->rbn_paren->rbn_color;
-                x->rbn_paren->rbn_color      = RB_BLACK;
-                sibling->rbn_left->rbn_color = RB_BLACK;
-                rb_rotate_l (rootp, 
-                             x->rbn_paren);
+                sibling = RB_COW (tree, sibling);
+                rb_set_color (sibling, rb_color (rb_paren (x)));
+                rb_set_color (rb_paren (x), RB_BLACK);
+                rb_set_color (sibling->rbn_left, RB_BLACK);
+                rb_rotate_r (rootp, 
+                             rb_paren (x),
+                             tree->rb_aug);
                 x                            = *rootp;
             }
         }
     }
-    x->rbn_color = RB_BLACK;
+    rb_set_color (x, RB_BLACK);
 }
 
 static rc_t
-rb_int_remove (rb_node_t **rootp,
+rb_int_remove (rb_tree_t  *tree,
                rb_node_t  *z,
                rb_cmp_t    cmp)
 {
-    rb_node_t *x;
-    rb_node_t *y;
-    rb_color_t color;
+    rb_node_t **rootp = &tree->rb_root;
+    rb_node_t  *x;
+    rb_node_t  *y;
+    rb_node_t  *fix;                    /* lowest subtree that changed */
+    rb_color_t  color;
 
+    z     = RB_COW (tree, z);
     y     = z;
-    color = y->rbn_color;
+    color = rb_color (y);
+    fix   = rb_paren (z);
 
     if (z->rbn_left == RB_NIL)
     {
+        rb_size_add_path (rb_paren (z), -1);
         x = z->rbn_right;
         rb_transplant (rootp, 
                        z, 
@@ -402,6 +855,7 @@ rb_int_remove (rb_node_t **rootp,
     }
     else if (z->rbn_right == RB_NIL)
     {
+        rb_size_add_path (rb_paren (z), -1);
         x = z->rbn_left;
         rb_transplant (rootp, 
                        z, 
@@ -410,344 +864,2314 @@ rb_int_remove (rb_node_t **rootp,
     else
     {
         rb_min (z->rbn_right, &y);
-        color = y->rbn_color;
+        y     = RB_COW (tree, y);
+        rb_size_add_path (rb_paren (y), -1);
+        color = rb_color (y);
         x     = y->rbn_right;
+        fix   = (rb_paren (y) == z) ? y : rb_paren (y);
 
-        if (y->rbn_paren == z)
-            x->rbn_paren = z;
+        if (rb_paren (y) == z)
+            rb_set_paren (x, y);
         else
         {
             rb_transplant (rootp, 
                            y, 
                            y->rbn_right);
             y->rbn_right            = z->rbn_right;
-            y->rbn_right->rbn_paren = y;
+            rb_set_paren (y->rbn_right, y);
         }
         rb_transplant (rootp, 
                        z, 
                        y);
         y->rbn_left            = z->rbn_left;
-        y->rbn_left->rbn_paren = y;
-        y->rbn_color           = z->rbn_color;
+        rb_set_paren (y->rbn_left, y);
+        rb_set_color (y, rb_color (z));
+        RB_SIZE_SET (y, z->rbn_size);
     }
+    /* fix's path runs through y's new place, so no early stop */
+    if (tree->rb_aug)
+        rb_aug_path (fix, tree->rb_aug, 0);
     if (color == RB_BLACK)
-        rb_remove_fixup (rootp, 
+        rb_remove_fixup (tree, 
                          x, 
                          cmp);
-    if (z == *rootp)
-        *rootp = RB_NIL;
-    rbn_delete (NULL, z);
+    rbn_free (tree, z);
     return (ROK);
 }
 
-rc_t
-rb_int_find (rb_node_t  *root,
-             void       *data,
-             rb_cmp_t    cmp,
-             rb_node_t **nodep)
+/*
+ * Join and split.
+ *
+ * These work on detached subtrees: a root with no parent, coloured black,
+ * carried together with its black height (the black nodes on any path
+ * down from, and including, the root) so that no operation has to
+ * measure it. Joining trees of black heights h1 >= h2 walks down only
+ * h1 - h2 black levels, so a split costs O(log n) in total and the set
+ * operations built on them O(m log(n/m + 1)).
+ */
+typedef struct rb_sub_
 {
-    rb_node_t *node;
-    int        rc;
-
-    node = root;
-    while (1)
-    {                                               
-        if (node == RB_NIL)                     
-            break;                                  
-        rc = (*cmp)((uintptr_t) data, 
-                    (uintptr_t) node->rbn_data); 
-        if (rc == 0)
-            break;
-        node = ((rc < 0)          ? 
-                    node->rbn_left : 
-                    node->rbn_right);   
-    }                                               
-    *nodep = node;
-    return ((node != RB_NIL) ? ROK : RFAIL); 
-
-}
+    rb_node_t *rs_root;
+    int        rs_bh;
+} rb_sub_t;
 
-static rb_node_t*                                      
-rb_next (rb_node_t* rb_node)
-{                                                       
-    rb_node_t* node;
+static const rb_sub_t rb_sub_empty = { (rb_node_t*) &rb_nil_node, 0 };
 
-    if (rb_node->rbn_right != RB_NIL)        
-    {
-        rb_min(rb_node->rbn_right, 
-               &node);
-        return (node);
-    } 
+/* Black height of a whole tree, from its leftmost path */
+static int
+rb_int_bh (rb_node_t  *root)
+{
+    int bh = 0;
 
-    node = rb_node->rbn_paren;                  
-    while ((node != RB_NIL) &&                      
-           (rb_node == node->rbn_right))         
-    {                                                   
-        rb_node = node;                             
-        node    = node->rbn_paren;              
-    }                                                   
-    return (node);                                      
+    for (; root != RB_NIL; root = root->rbn_left)
+        bh += (rb_color (root) == RB_BLACK);
+    return (bh);
 }
 
-int
-rb_int_height (rb_node_t  *root)
+/* Detach child c of paren, whose black height is bh, as a subtree */
+static inline rb_sub_t
+rb_sub_child (rb_node_t  *c,
+              rb_node_t  *paren,
+              int         bh)
 {
-    int hl, hr;
+    rb_sub_t sub;
 
-    if (root != RB_NIL)
+    sub.rs_root = c;
+    sub.rs_bh   = bh - (rb_color (paren) == RB_BLACK);
+    if (c != RB_NIL)
     {
-        hl = rb_int_height (root->rbn_left);
-        hr = rb_int_height (root->rbn_right);
-        if (hl >= hr)
-            return hl + 1;
-        else 
-            return hr + 1;
-
+        rb_set_paren (c, RB_NIL);
+        if (rb_color (c) == RB_RED)
+        {
+            rb_set_color (c, RB_BLACK);
+            ++sub.rs_bh;
+        }
     }
-    return 0;
+    return (sub);
 }
 
-void
-rb_int_inorder (rb_node_t   *root, 
-                void        *cb, 
-                rb_visit_t   visit2)
+/* l < k < r: hang k and the shorter tree off the taller one's spine */
+static rb_sub_t
+rb_int_join (rb_sub_t    l,
+             rb_node_t  *k,
+             rb_sub_t    r)
 {
-    rb_node_t *node = root;
-
-    rb_min (root, &node);
-    for (;node != RB_NIL; node = rb_next (node))
-        (*visit2) (cb, node);
-}
+    rb_sub_t   t;
+    rb_node_t *x;
+    rb_node_t *p;
+    int        h;
 
-void
-rb_int_preorder (rb_node_t   *root, 
-                 void        *cb, 
-                 rb_visit_t   visit2)
-{
-    if (root != RB_NIL)
+    if (l.rs_bh == r.rs_bh)
     {
-        (*visit2)(cb, 
-                  root);
-        rb_int_preorder (root->rbn_left, 
-                          cb, 
-                          visit2);
-        rb_int_preorder (root->rbn_right, 
-                          cb, 
-                          visit2);
+        k->rbn_left  = l.rs_root;
+        k->rbn_right = r.rs_root;
+        rb_set_paren (k, RB_NIL);
+        rb_set_color (k, RB_BLACK);
+        if (l.rs_root != RB_NIL)
+            rb_set_paren (l.rs_root, k);
+        if (r.rs_root != RB_NIL)
+            rb_set_paren (r.rs_root, k);
+        RB_SIZE_FIX (k);
+        t.rs_root = k;
+        t.rs_bh   = l.rs_bh + 1;
+        return (t);
     }
-}
+
+    if (l.rs_bh > r.rs_bh)
+    {
+        /* First black node on l's right spine as tall as r */
+        t = l;
+        p = RB_NIL;
+        x = l.rs_root;
+        h = l.rs_bh;
+        while ((h > r.rs_bh) || (rb_color (x) == RB_RED))
+        {
+            h -= (rb_color (x) == RB_BLACK);
+            p  = x;
+            x  = x->rbn_right;
+        }
+        k->rbn_left  = x;
+        k->rbn_right = r.rs_root;
+        p->rbn_right = k;
+    }
+    else
+    {
+        t = r;
+        p = RB_NIL;
+        x = r.rs_root;
+        h = r.rs_bh;
+        while ((h > l.rs_bh) || (rb_color (x) == RB_RED))
+        {
+            h -= (rb_color (x) == RB_BLACK);
+            p  = x;
+            x  = x->rbn_left;
+        }
+        k->rbn_left  = l.rs_root;
+        k->rbn_right = x;
+        p->rbn_left  = k;
+    }
+
+    rb_set_paren (k, p);
+    rb_set_color (k, RB_RED);
+    if (k->rbn_left != RB_NIL)
+        rb_set_paren (k->rbn_left, k);
+    if (k->rbn_right != RB_NIL)
+        rb_set_paren (k->rbn_right, k);
+    RB_SIZE_FIX (k);
+#ifdef RB_ORDER_STAT
+    rb_size_add_path (p, (k->rbn_size - x->rbn_size));
+#endif
+    t.rs_bh += rb_insert_fixup (&t.rs_root, k, NULL);
+    return (t);
+}
+
+/* 
+ * Split t around item. Keys comparing below item go to lo and above it to
+ * hi. What happens to an equal key depends on eq: 0 stops there and hands
+ * that node back in mid, -1 sends it to hi and 1 sends it to lo.
+ */
+static void
+rb_int_split (rb_sub_t     t,
+              void        *item,
+              rb_cmp_t     cmp,
+              int          eq,
+              rb_sub_t    *lo,
+              rb_node_t  **mid,
+              rb_sub_t    *hi)
+{
+    rb_node_t *node = t.rs_root;
+    rb_sub_t   l;
+    rb_sub_t   r;
+    rb_sub_t   part;
+    int        rc;
+
+    if (node == RB_NIL)
+    {
+        *lo  = rb_sub_empty;
+        *hi  = rb_sub_empty;
+        *mid = RB_NIL;
+        return;
+    }
+
+    rc = (*cmp)((uintptr_t) item, node->rbn_data);
+    if (rc == 0)
+        rc = eq;
+    l = rb_sub_child (node->rbn_left,  node, t.rs_bh);
+    r = rb_sub_child (node->rbn_right, node, t.rs_bh);
+
+    if (rc == 0)
+    {
+        *lo  = l;
+        *mid = node;
+        *hi  = r;
+    }
+    else if (rc < 0)
+    {
+        rb_int_split (l, item, cmp, eq, lo, mid, &part);
+        *hi = rb_int_join (part, node, r);
+    }
+    else
+    {
+        rb_int_split (r, item, cmp, eq, &part, mid, hi);
+        *lo = rb_int_join (l, node, part);
+    }
+}
+
+/* Cut the smallest node out of t (not empty) */
+static rb_sub_t
+rb_int_split_first (rb_sub_t     t,
+                    rb_node_t  **minp)
+{
+    rb_node_t *node = t.rs_root;
+    rb_sub_t   l;
+    rb_sub_t   r;
+
+    l = rb_sub_child (node->rbn_left,  node, t.rs_bh);
+    r = rb_sub_child (node->rbn_right, node, t.rs_bh);
+    if (l.rs_root == RB_NIL)
+    {
+        *minp = node;
+        return (r);
+    }
+    return (rb_int_join (rb_int_split_first (l, minp), node, r));
+}
+
+/* l < r, no pivot */
+static rb_sub_t
+rb_int_join2 (rb_sub_t    l,
+              rb_sub_t    r)
+{
+    rb_node_t *k;
+
+    if (r.rs_root == RB_NIL)
+        return (l);
+    r = rb_int_split_first (r, &k);
+    return (rb_int_join (l, k, r));
+}
+
+static inline rb_sub_t
+rb_tree_sub (rb_tree_t  *tree)
+{
+    rb_sub_t sub;
+
+    sub.rs_root = tree->rb_root;
+    sub.rs_bh   = rb_int_bh (tree->rb_root);
+    return (sub);
+}
+
+/* Set operations: state shared by the recursion */
+typedef struct rb_setop_
+{
+    rb_tree_t *so_tree;                 /* owner of every node involved     */
+    rb_cmp_t   so_cmp;
+    rb_dtor_t  so_dtor;                 /* for data of dropped nodes        */
+    uint32_t   so_dropped;
+} rb_setop_t;
+
+static void
+rb_setop_drop (void       *cb,
+               rb_node_t  *node)
+{
+    rb_setop_t *op = cb;
+
+    if (op->so_dtor)
+        (*op->so_dtor) (node->rbn_data);
+    rbn_free (op->so_tree, node);
+    ++op->so_dropped;
+}
+
+void
+rb_int_pstorder (rb_node_t   *root, 
+                 void        *cb, 
+                 rb_visit_t   visit2);
+
+static rb_sub_t
+rb_int_union (rb_setop_t *op,
+              rb_sub_t    a,
+              rb_sub_t    b)
+{
+    rb_node_t *k;
+    rb_node_t *m;
+    rb_sub_t   al, ar;
+    rb_sub_t   bl, br;
+
+    if (a.rs_root == RB_NIL)
+        return (b);
+    if (b.rs_root == RB_NIL)
+        return (a);
+
+    k  = b.rs_root;
+    bl = rb_sub_child (k->rbn_left,  k, b.rs_bh);
+    br = rb_sub_child (k->rbn_right, k, b.rs_bh);
+    rb_int_split (a, (void*) k->rbn_data, op->so_cmp, 0, &al, &m, &ar);
+    al = rb_int_union (op, al, bl);
+    ar = rb_int_union (op, ar, br);
+    if (m != RB_NIL)
+    {
+        /* Keep the first tree's node so its handles stay valid */
+        rb_setop_drop (op, k);
+        k = m;
+    }
+    return (rb_int_join (al, k, ar));
+}
+
+static rb_sub_t
+rb_int_intersect (rb_setop_t *op,
+                  rb_sub_t    a,
+                  rb_sub_t    b)
+{
+    rb_node_t *k;
+    rb_node_t *m;
+    rb_sub_t   al, ar;
+    rb_sub_t   bl, br;
+
+    if ((a.rs_root == RB_NIL) ||
+        (b.rs_root == RB_NIL))
+    {
+        rb_int_pstorder (a.rs_root, op, rb_setop_drop);
+        rb_int_pstorder (b.rs_root, op, rb_setop_drop);
+        return (rb_sub_empty);
+    }
+
+    k  = b.rs_root;
+    bl = rb_sub_child (k->rbn_left,  k, b.rs_bh);
+    br = rb_sub_child (k->rbn_right, k, b.rs_bh);
+    rb_int_split (a, (void*) k->rbn_data, op->so_cmp, 0, &al, &m, &ar);
+    al = rb_int_intersect (op, al, bl);
+    ar = rb_int_intersect (op, ar, br);
+    rb_setop_drop (op, k);
+    if (m != RB_NIL)
+        return (rb_int_join (al, m, ar));
+    return (rb_int_join2 (al, ar));
+}
+
+static rb_sub_t
+rb_int_difference (rb_setop_t *op,
+                   rb_sub_t    a,
+                   rb_sub_t    b)
+{
+    rb_node_t *k;
+    rb_node_t *m;
+    rb_sub_t   al, ar;
+    rb_sub_t   bl, br;
+
+    if ((a.rs_root == RB_NIL) ||
+        (b.rs_root == RB_NIL))
+    {
+        rb_int_pstorder (b.rs_root, op, rb_setop_drop);
+        return (a);
+    }
+
+    k  = b.rs_root;
+    bl = rb_sub_child (k->rbn_left,  k, b.rs_bh);
+    br = rb_sub_child (k->rbn_right, k, b.rs_bh);
+    rb_int_split (a, (void*) k->rbn_data, op->so_cmp, 0, &al, &m, &ar);
+    al = rb_int_difference (op, al, bl);
+    ar = rb_int_difference (op, ar, br);
+    rb_setop_drop (op, k);
+    if (m != RB_NIL)
+        rb_setop_drop (op, m);
+    return (rb_int_join2 (al, ar));
+}
+
+/* 
+ * Nodes are about to move from src to dst: both must allocate the same way,
+ * and slab memory follows the nodes.
+ */
+static rc_t
+rb_adopt (rb_tree_t  *dst,
+          rb_tree_t  *src)
+{
+    rb_slab_t *slab;
+    rb_node_t *node;
+
+    if (dst->rb_alloc != src->rb_alloc)
+        return (RFAIL);
+    if (src->rb_alloc != RB_ALLOC_SLAB)
+        return (ROK);
+
+    if (dst->rb_slabs == NULL)
+        dst->rb_slabs = src->rb_slabs;
+    else
+    {
+        for (slab = dst->rb_slabs; slab->rbs_next; slab = slab->rbs_next)
+            ;
+        slab->rbs_next = src->rb_slabs;
+    }
+    while ((node = src->rb_free) != RB_NIL)
+    {
+        src->rb_free    = node->rbn_right;
+        node->rbn_right = dst->rb_free;
+        dst->rb_free    = node;
+    }
+    src->rb_slabs = NULL;
+    return (ROK);
+}
+
+rc_t
+rb_int_find (rb_node_t  *root,
+             void       *data,
+             rb_cmp_t    cmp,
+             rb_node_t **nodep)
+{
+    rb_node_t *node;
+    int        rc;
+
+    node = root;
+    while (1)
+    {                                               
+        if (node == RB_NIL)                     
+            break;                                  
+        rc = (*cmp)((uintptr_t) data, 
+                    (uintptr_t) node->rbn_data); 
+        if (rc == 0)
+            break;
+        node = ((rc < 0)          ? 
+                    node->rbn_left : 
+                    node->rbn_right);   
+    }                                               
+    *nodep = node;
+    return ((node != RB_NIL) ? ROK : RFAIL); 
+
+}
+
+/**
+ * @brief In-order successor; RB_NIL past the last node.
+ *
+ * @param rb_node
+ */
+rb_node_t*                                      
+rb_next (rb_node_t* rb_node)
+{                                                       
+    rb_node_t* node;
+
+    if (rb_node == RB_NIL)
+        return (RB_NIL);
+
+    if (rb_node->rbn_right != RB_NIL)        
+    {
+        rb_min(rb_node->rbn_right, 
+               &node);
+        return (node);
+    } 
+
+    node = rb_paren (rb_node);                  
+    while ((node != RB_NIL) &&                      
+           (rb_node == node->rbn_right))         
+    {                                                   
+        rb_node = node;                             
+        node    = rb_paren (node);              
+    }                                                   
+    return (node);                                      
+}
+
+/**
+ * @brief In-order predecessor; RB_NIL before the first node.
+ *
+ * @param rb_node
+ */
+rb_node_t*                                      
+rb_prev (rb_node_t* rb_node)
+{                                                       
+    rb_node_t* node;
+
+    if (rb_node == RB_NIL)
+        return (RB_NIL);
+
+    if (rb_node->rbn_left != RB_NIL)        
+    {
+        rb_max(rb_node->rbn_left, 
+               &node);
+        return (node);
+    } 
+
+    node = rb_paren (rb_node);                  
+    while ((node != RB_NIL) &&                      
+           (rb_node == node->rbn_left))         
+    {                                                   
+        rb_node = node;                             
+        node    = rb_paren (node);              
+    }                                                   
+    return (node);                                      
+}
+
+/* First node whose key is >= data (strict: > data); RB_NIL if none */
+static rb_node_t*
+rb_int_bound (rb_node_t  *root,
+              void       *data,
+              rb_cmp_t    cmp,
+              int         strict)
+{
+    rb_node_t *node;
+    rb_node_t *bound;
+    int        rc;
+
+    bound = RB_NIL;
+    node  = root;
+    while (node != RB_NIL)
+    {
+        rc = (*cmp)((uintptr_t) data, 
+                    node->rbn_data);
+        if ((rc < 0) || (!strict && rc == 0))
+        {
+            bound = node;
+            node  = node->rbn_left;
+        }
+        else
+            node  = node->rbn_right;
+    }
+    return (bound);
+}
+
+int
+rb_int_height (rb_node_t  *root)
+{
+    int hl, hr;
+
+    if (root != RB_NIL)
+    {
+        hl = rb_int_height (root->rbn_left);
+        hr = rb_int_height (root->rbn_right);
+        if (hl >= hr)
+            return hl + 1;
+        else 
+            return hr + 1;
+
+    }
+    return 0;
+}
+
+/*
+ * The walks below are iterative and use the parent pointers, so they need
+ * constant stack whatever the depth. Each one works out the next node
+ * before visiting the current one and prefetches the node it will need
+ * after that. Only the post-order and level-order walks let a visitor free
+ * the node it is handed: nothing visited is read again. In-order and
+ * pre-order walks climb back through nodes they have already visited.
+ */
+
+#define RB_PREFETCH(n)  __builtin_prefetch ((n))
+
+void
+rb_int_inorder (rb_node_t   *root, 
+                void        *cb, 
+                rb_visit_t   visit2)
+{
+    rb_node_t *node = root;
+    rb_node_t *next;
+
+    rb_min (root, &node);
+    for (; node != RB_NIL; node = next)
+    {
+        next = rb_next (node);
+        RB_PREFETCH (next->rbn_right);
+        (*visit2) (cb, node);
+    }
+}
+
+void
+rb_int_preorder (rb_node_t   *root, 
+                 void        *cb, 
+                 rb_visit_t   visit2)
+{
+    rb_node_t *node;
+    rb_node_t *next;
+    rb_node_t *paren;
+
+    for (node = root; node != RB_NIL; node = next)
+    {
+        if (node->rbn_left != RB_NIL)
+        {
+            next = node->rbn_left;
+            RB_PREFETCH (node->rbn_right);
+        }
+        else if (node->rbn_right != RB_NIL)
+            next = node->rbn_right;
+        else
+        {
+            /* Climb to the first ancestor with an unvisited right subtree */
+            next = node;
+            for (;;)
+            {
+                if (next == root)
+                {
+                    next = RB_NIL;
+                    break;
+                }
+                paren = rb_paren (next);
+                if ((next == paren->rbn_left) &&
+                    (paren->rbn_right != RB_NIL))
+                {
+                    next = paren->rbn_right;
+                    break;
+                }
+                next = paren;
+            }
+        }
+        (*visit2) (cb, node);
+    }
+}
+
+/* First node of the subtree in post-order: its leftmost, deepest leaf */
+static inline rb_node_t*
+rb_pstorder_first (rb_node_t *node)
+{
+    for (;;)
+    {
+        if (node->rbn_left != RB_NIL)
+            node = node->rbn_left;
+        else if (node->rbn_right != RB_NIL)
+            node = node->rbn_right;
+        else
+            return (node);
+    }
+}
 
 void
 rb_int_pstorder  (rb_node_t   *root, 
                   void        *cb, 
                   rb_visit_t   visit2)
 {
-    if (root != RB_NIL)
+    rb_node_t *node;
+    rb_node_t *next;
+    rb_node_t *paren;
+
+    if (root == RB_NIL)
+        return;
+
+    for (node = rb_pstorder_first (root); node != RB_NIL; node = next)
+    {
+        paren = rb_paren (node);
+        if (node == root)
+            next = RB_NIL;
+        else if ((node == paren->rbn_left) &&
+                 (paren->rbn_right != RB_NIL))
+            next = rb_pstorder_first (paren->rbn_right);
+        else
+            next = paren;
+        RB_PREFETCH (paren);
+        (*visit2) (cb, node);
+    }
+}
+
+/*
+ * Breadth first, through a queue buffer kept in the tree and reused by
+ * later walks. Every node is queued once, so the buffer is sized to the
+ * node count; children are queued before their parent is visited.
+ */
+static void
+rb_int_lvlorder (rb_tree_t   *tree, 
+                 void        *cb, 
+                 rb_visit_t   visit2)
+{
+    rb_node_t **queue;
+    rb_node_t  *node;
+    uint32_t    head;
+    uint32_t    tail;
+
+    if (tree->rb_root == RB_NIL)
+        return;
+
+    if (tree->rb_qcap < tree->rb_cnt)
+    {
+        queue = realloc (tree->rb_qbuf, tree->rb_cnt * sizeof(*queue));
+        assert (queue);
+        if (queue == NULL)
+            return;
+        tree->rb_qbuf = queue;
+        tree->rb_qcap = tree->rb_cnt;
+    }
+
+    queue        = tree->rb_qbuf;
+    head         = 0;
+    tail         = 0;
+    queue [tail++] = tree->rb_root;
+    while (head != tail)
+    {
+        node = queue [head++];
+        if (head + 4 < tail)
+            RB_PREFETCH (queue [head + 4]);
+        if (node->rbn_left != RB_NIL)
+            queue [tail++] = node->rbn_left;
+        if (node->rbn_right != RB_NIL)
+            queue [tail++] = node->rbn_right;
+        (*visit2) (cb, node);
+    }
+}
+
+/**************************************************************************
+ *                                   API                                  *
+ **************************************************************************/ 
+
+/**
+ * @brief 
+ *
+ * @param treep
+ */
+void
+rb_init (rb_tree_t *tree)
+{
+    rb_int_init (&tree->rb_root);
+    tree->rb_cnt        = 0;
+    tree->rb_alloc      = RB_ALLOC_HEAP;
+    tree->rb_slab_nodes = 0;
+    tree->rb_slabs      = NULL;
+    tree->rb_free       = RB_NIL;
+    tree->rb_qbuf       = NULL;
+    tree->rb_qcap       = 0;
+    tree->rb_aug        = NULL;
+#ifdef RB_SNAPSHOT
+    tree->rb_snaps      = 0;
+#endif
+}
+
+/**
+ * @brief Initialize a tree whose nodes are carved out of per-tree slabs.
+ *        Removed nodes go to a free list and are reused by later inserts;
+ *        the slabs themselves are only returned by rb_delete.
+ *
+ * @param tree
+ * @param slab_nodes Nodes per slab; 0 selects RB_SLAB_DFLT_NODES.
+ */
+void
+rb_init_slab (rb_tree_t *tree,
+              uint32_t   slab_nodes)
+{
+    rb_init (tree);
+    tree->rb_alloc      = RB_ALLOC_SLAB;
+    tree->rb_slab_nodes = (slab_nodes) ? slab_nodes : RB_SLAB_DFLT_NODES;
+}
+
+/**
+ * @brief Initialize an intrusive tree. Callers embed rb_node_t in their own
+ *        objects, link them with rb_insert_node() and unlink them with
+ *        rb_remove_handle(); the tree itself never allocates or frees a
+ *        node. Use rb_entry() to get from a node back to its container.
+ *
+ * @param tree
+ */
+void
+rb_init_intrusive (rb_tree_t *tree)
+{
+    rb_init (tree);
+    tree->rb_alloc = RB_ALLOC_NONE;
+}
+
+/**
+ * @brief Prepare a caller owned node for rb_insert_node().
+ *
+ * @param node
+ * @param item Key the node is ordered by
+ */
+void
+rb_node_init (rb_node_t *node,
+              void      *item)
+{
+    node->rbn_left  = RB_NIL;
+    node->rbn_right = RB_NIL;
+    rb_set_paren (node, RB_NIL);
+    node->rbn_data  = (uintptr_t) item;
+    rb_set_color (node, RB_RED);
+    RB_SIZE_SET (node, 1);
+    RB_REF_SET (node, 1);
+}
+
+static void
+rb_aug_visit (void       *aug,
+              rb_node_t  *node)
+{
+    rb_augment_t func = (rb_augment_t) aug;
+
+    (void) (*func) (node);
+}
+
+/**
+ * @brief Keep a per-node augmented value (e.g. a subtree maximum) up to
+ *        date. aug recomputes it for one node from the node itself and its
+ *        children (either may be RB_NIL), and returns nonzero if it
+ *        changed. It is called on the nodes of every insert and remove
+ *        path and on both nodes of every rotation, children first, so
+ *        values stay exact at O(log n) extra calls per update. Setting it
+ *        on a non-empty tree computes every node's value once, bottom up.
+ *
+ *        Operations that relink the tree wholesale (rb_build_sorted, the
+ *        rebuild in rb_insert_batch, join, split and the set operations)
+ *        fail or fall back on augmented trees.
+ *
+ * @param tree
+ * @param aug   NULL turns augmentation off
+ */
+void
+rb_set_augment (rb_tree_t    *tree,
+                rb_augment_t  aug)
+{
+    tree->rb_aug = aug;
+    if (aug)
+        rb_int_pstorder (tree->rb_root, (void*) aug, rb_aug_visit);
+}
+
+/**
+ * @brief 
+ *
+ * @param tree
+ */
+void
+rb_new (rb_tree_t **treep)
+{
+    rb_tree_t *tree;
+
+    tree = calloc(1, sizeof(*tree));
+    if (tree != NULL)
+        rb_init (tree);
+    *treep = tree;
+}
+
+/**
+ * @brief 
+ *
+ * @param treep
+ * @param slab_nodes
+ */
+void
+rb_new_slab (rb_tree_t **treep,
+             uint32_t    slab_nodes)
+{
+    rb_tree_t *tree;
+
+    tree = calloc(1, sizeof(*tree));
+    if (tree != NULL)
+        rb_init_slab (tree, slab_nodes);
+    *treep = tree;
+}
+
+void
+rb_walk  (rb_tree_t       *tree, 
+          rb_trav_order_t  order,
+          void            *cb, 
+          rb_visit_t       visit)
+{
+    switch (order)
+    {
+    default:
+        break;
+
+    case RB_TRAV_INORDER:
+        rb_int_inorder (tree->rb_root, cb, visit);
+        break;
+
+    case RB_TRAV_PREORDER:
+        rb_int_preorder (tree->rb_root, cb, visit);
+        break;
+
+    case RB_TRAV_PSTORDER:
+        rb_int_pstorder (tree->rb_root, cb, visit);
+        break;
+
+    case RB_TRAV_LVLORDER:
+        rb_int_lvlorder (tree, cb, visit);
+        break;
+    }
+}
+
+/**
+ * @brief 
+ *
+ * @param tree
+ * @param dtor
+ */
+void
+rb_delete (rb_tree_t **treep, 
+           rb_dtor_t   dtor)
+{
+    rb_tree_t *tree;
+
+    if (!treep || !*treep)
+        return;
+
+    tree = *treep;
+    assert (RB_SNAPS (tree) == 0);
+    if (tree->rb_alloc != RB_ALLOC_HEAP)
+    {
+        /* Whole slabs go back at once (intrusive nodes are not ours);
+         * only walk if data needs a dtor. */
+        if (dtor)
+            rb_walk (tree, RB_TRAV_INORDER, dtor, rbn_dtor);
+        rb_slab_release (tree);
+    }
+    else
+        (void) rb_int_destroy (tree, tree->rb_root, dtor);
+    free (tree->rb_qbuf);
+    free (tree);
+    *treep = NULL;
+}
+
+int
+rb_height (rb_tree_t  *tree)
+{
+    return (rb_int_height(tree->rb_root));
+}
+/**
+ * @brief 
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ * @param nodep Receives the node, RB_NIL (rb_nilp) if item is absent
+ */
+void
+rb_find (rb_tree_t  *tree, 
+         void       *item, 
+         rb_cmp_t    cmp,
+         rb_node_t **nodep)
+{
+
+    rb_int_find (tree->rb_root,
+                 item,
+                 cmp,
+                 nodep);
+}
+
+/**
+ * @brief rb_find() returning the handle: the node, or RB_NIL (rb_nilp) if
+ *        item is absent.
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ */
+rb_node_t*
+rb_lookup (rb_tree_t  *tree,
+           void       *item,
+           rb_cmp_t    cmp)
+{
+    rb_node_t *node;
+
+    rb_int_find (tree->rb_root, item, cmp, &node);
+    return (node);
+}
+        
+/**
+ * @brief 
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ */
+void
+rb_insert (rb_tree_t  *tree, 
+           void       *item, 
+           rb_cmp_t    cmp,
+           rb_node_t **nodep)
+{
+    rc_t       rc;
+
+    rc = rb_int_insert (tree, 
+                        item, 
+                        cmp,
+                        nodep);
+    if (rc == ROK)
+        ++tree->rb_cnt;
+    return; 
+}
+
+
+/**
+ * @brief Insert item next to hint, a node of the tree, when it belongs
+ *        there: between hint and its successor or its predecessor. That
+ *        costs at most two comparisons and an O(1) amortized rebalance,
+ *        so feeding back the node returned by the previous call makes
+ *        sorted or append-mostly input skip the descent altogether.
+ *        Otherwise (or with hint RB_NIL) it is an ordinary rb_insert().
+ *
+ * @param tree
+ * @param hint
+ * @param item
+ * @param cmp
+ *
+ * @return The new node; RB_NIL if the tree is intrusive.
+ */
+rb_node_t*
+rb_insert_hint (rb_tree_t  *tree,
+                rb_node_t  *hint,
+                void       *item,
+                rb_cmp_t    cmp)
+{
+    rb_node_t *z;
+    rb_node_t *near;
+
+    rbn_new (tree, &z, (uintptr_t) item);
+    if (z == NULL)
+        return (RB_NIL);
+
+    if (hint != RB_NIL)
+    {
+        if ((*cmp)(z->rbn_data, hint->rbn_data) >= 0)
+        {
+            /* hint <= item < next: right of hint, or left of next */
+            near = rb_next (hint);
+            if ((near == RB_NIL) ||
+                ((*cmp)(z->rbn_data, near->rbn_data) < 0))
+            {
+                if (hint->rbn_right == RB_NIL)
+                    rb_link_at (tree, hint, 1, z);
+                else
+                    rb_link_at (tree, near, -1, z);
+                return (z);
+            }
+        }
+        else
+        {
+            /* prev <= item < hint: left of hint, or right of prev */
+            near = rb_prev (hint);
+            if ((near == RB_NIL) ||
+                ((*cmp)(z->rbn_data, near->rbn_data) >= 0))
+            {
+                if (hint->rbn_left == RB_NIL)
+                    rb_link_at (tree, hint, -1, z);
+                else
+                    rb_link_at (tree, near, 1, z);
+                return (z);
+            }
+        }
+    }
+    rb_int_link (tree, z, cmp);
+    ++tree->rb_cnt;
+    return (z);
+}
+
+/**
+ * @brief Link a caller owned node (see rb_init_intrusive) into the tree.
+ *        Never allocates.
+ *
+ * @param tree
+ * @param node Node prepared with rb_node_init()
+ * @param cmp
+ */
+void
+rb_insert_node (rb_tree_t  *tree, 
+                rb_node_t  *node, 
+                rb_cmp_t    cmp)
+{
+    rb_int_link (tree, node, cmp);
+    ++tree->rb_cnt;
+}
+
+/**
+ * @brief Link a prepared node at a position the caller has already found,
+ *        for callers that do their own (e.g. inlined) descent; see
+ *        rbtree-template.h. No comparisons are made.
+ *
+ * @param tree
+ * @param paren Last node of the descent, RB_NIL (rb_nilp) if tree is empty
+ * @param dir   Side of paren to link on: < 0 left, otherwise right. That
+ *              child must be RB_NIL.
+ * @param node  Node prepared with rb_node_init()
+ */
+void
+rb_link_at (rb_tree_t  *tree,
+            rb_node_t  *paren,
+            int         dir,
+            rb_node_t  *node)
+{
+    paren = RB_COW (tree, paren);
+    rb_size_add_path (paren, 1);
+    rb_int_attach (&tree->rb_root, paren, dir, node, tree->rb_aug);
+    ++tree->rb_cnt;
+}
+
+/**
+ * @brief rb_link_at() for a node the tree allocates for item.
+ *
+ * @param tree
+ * @param paren
+ * @param dir
+ * @param item
+ *
+ * @return The new node; RB_NIL if the tree is intrusive.
+ */
+rb_node_t*
+rb_insert_at (rb_tree_t  *tree,
+              rb_node_t  *paren,
+              int         dir,
+              void       *item)
+{
+    rb_node_t *node;
+
+    rbn_new (tree, &node, (uintptr_t) item);
+    if (node == NULL)
+        return (RB_NIL);
+    rb_link_at (tree, paren, dir, node);
+    return (node);
+}
+
+/**
+ * @brief Build the tree from items already sorted by the tree's comparator
+ *        in O(n), without comparisons or rotations. The tree keeps its
+ *        allocation mode: a slab tree gets all nodes contiguously, in key
+ *        order, in one new slab freed with the others; a heap tree stays
+ *        RB_ALLOC_HEAP with one allocation per node.
+ *
+ * @param tree  Empty, non-intrusive tree
+ * @param items Sorted items
+ * @param n
+ *
+ * @return ROK on success; RFAIL if the tree is not empty, is intrusive or
+ *         augmented, has live snapshots or memory runs out.
+ */
+rc_t
+rb_build_sorted (rb_tree_t  *tree,
+                 void      **items,
+                 uint32_t    n)
+{
+    rb_slab_t  *slab;
+    rb_node_t **vec;
+    uint32_t    i;
+
+    if ((tree->rb_root  != RB_NIL) ||
+        (tree->rb_alloc == RB_ALLOC_NONE) ||
+        (tree->rb_aug   != NULL) ||
+        RB_SNAPS (tree))
+        return (RFAIL);
+    if (n == 0)
+        return (ROK);
+
+    if (tree->rb_alloc == RB_ALLOC_HEAP)
+    {
+        /* Nodes are freed one by one, so they are allocated one by one */
+        vec = malloc ((size_t) n * sizeof(*vec));
+        if (vec == NULL)
+            return (RFAIL);
+        for (i = 0; i < n; ++i)
+        {
+            rbn_new (tree, &vec [i], (uintptr_t) items [i]);
+            if (vec [i] == NULL)
+            {
+                while (i-- > 0)
+                    rbn_free (tree, vec [i]);
+                free (vec);
+                return (RFAIL);
+            }
+        }
+
+        rb_int_rebuild (tree, NULL, vec, n);
+        free (vec);
+        return (ROK);
+    }
+
+    slab = malloc (sizeof(*slab) + (size_t) n * sizeof(rb_node_t));
+    if (slab == NULL)
+        return (RFAIL);
+    slab->rbs_cnt  = n;
+    slab->rbs_used = n;
+
+    for (i = 0; i < n; ++i)
+        slab->rbs_nodes [i].rbn_data = (uintptr_t) items [i];
+
+    rb_int_rebuild (tree, slab->rbs_nodes, NULL, n);
+
+    /* Behind the current slab so its unused nodes are still handed out */
+    if (tree->rb_slabs)
+    {
+        slab->rbs_next           = tree->rb_slabs->rbs_next;
+        tree->rb_slabs->rbs_next = slab;
+    }
+    else
+    {
+        slab->rbs_next = NULL;
+        tree->rb_slabs = slab;
+    }
+    return (ROK);
+}
+
+/* Batches at least this fraction of the tree size are merged and rebuilt */
+#define RB_BATCH_REBUILD_DIV    4
+
+/**
+ * @brief Insert a batch of items. The batch is sorted first (the items
+ *        array itself is left alone). Small batches are then inserted by
+ *        finger search: each descent starts from the lowest ancestor of the
+ *        previous insert that can hold the next key, so neighbouring keys
+ *        share most of their search path. A batch that is large relative
+ *        to the tree is merged with the tree's nodes in one pass and the
+ *        tree is rebuilt balanced in O(n + m). Existing nodes are relinked,
+ *        not copied, so node handles stay valid either way.
+ *
+ * @param tree  Non-intrusive tree
+ * @param items
+ * @param n
+ * @param cmp
+ *
+ * @return ROK on success; RFAIL if the tree is intrusive or memory runs
+ *         out (the tree is left unchanged in that case).
+ */
+rc_t
+rb_insert_batch (rb_tree_t  *tree,
+                 void      **items,
+                 uint32_t    n,
+                 rb_cmp_t    cmp)
+{
+    void      **sorted;
+    rb_node_t **vec;
+    rb_node_t  *node;
+    rb_node_t  *x;
+    rb_node_t  *y;
+    uint32_t    cnt;
+    uint32_t    i, j, k;
+
+    if (tree->rb_alloc == RB_ALLOC_NONE)
+        return (RFAIL);
+    if (n == 0)
+        return (ROK);
+
+    cnt    = tree->rb_cnt;
+    sorted = malloc (2 * (size_t) n * sizeof(*sorted));
+    vec    = malloc (((size_t) n + cnt) * sizeof(*vec));
+    if ((sorted == NULL) || (vec == NULL))
+    {
+        free (sorted);
+        free (vec);
+        return (RFAIL);
+    }
+    for (i = 0; i < n; ++i)
+        sorted [i] = items [i];
+    rb_sort (sorted, sorted + n, n, cmp);
+
+    /* Allocate everything up front so failure leaves the tree untouched */
+    for (i = 0; i < n; ++i)
+    {
+        rbn_new (tree, &vec [i], (uintptr_t) sorted [i]);
+        if (vec [i] == NULL)
+        {
+            while (i-- > 0)
+                rbn_free (tree, vec [i]);
+            free (sorted);
+            free (vec);
+            return (RFAIL);
+        }
+    }
+
+    /* 
+     * A rebuild relinks every node, which live snapshots would see, and
+     * knows nothing of augmented values.
+     */
+    if (((uint64_t) n * RB_BATCH_REBUILD_DIV >= cnt) &&
+        (tree->rb_aug == NULL) &&
+        !RB_SNAPS (tree))
+    {
+        /* Merge: existing nodes in order, then the new ones, into vec */
+        for (i = n; i > 0; --i)
+            vec [cnt + i - 1] = vec [i - 1];
+        x = rb_first (tree);
+        for (j = cnt, k = 0; k < cnt + n; ++k)
+        {
+            if ((x != RB_NIL) &&
+                ((j == cnt + n) ||
+                 ((*cmp)(vec [j]->rbn_data, x->rbn_data) >= 0)))
+            {
+                node = x;
+                x    = rb_next (x);
+            }
+            else
+                node = vec [j++];
+            vec [k] = node;
+        }
+        rb_int_rebuild (tree, NULL, vec, cnt + n);
+    }
+    else
+    {
+        y = RB_NIL;
+        for (i = 0; i < n; ++i)
+        {
+            /* Climb from the last insert until the next key fits below */
+            x = (y == RB_NIL) ? tree->rb_root : y;
+            while (x != tree->rb_root)
+            {
+                if ((x == rb_paren (x)->rbn_left) &&
+                    ((*cmp)(vec [i]->rbn_data, 
+                            rb_paren (x)->rbn_data) < 0))
+                    break;
+                x = rb_paren (x);
+            }
+            rb_int_link_from (tree, x, vec [i], cmp);
+            y = vec [i];
+        }
+        tree->rb_cnt += n;
+    }
+
+    free (sorted);
+    free (vec);
+    return (ROK);
+}
+
+/* 
+ * Node counts of two detached subtrees holding total nodes between them:
+ * read off the sizes with RB_ORDER_STAT, otherwise found by walking both
+ * in step until the smaller one runs out, O(min (n1, n2)).
+ */
+static void
+rb_int_count2 (rb_node_t  *a,
+               rb_node_t  *b,
+               uint32_t    total,
+               uint32_t   *cntap,
+               uint32_t   *cntbp)
+{
+#ifdef RB_ORDER_STAT
+    (void) total;
+    *cntap = a->rbn_size;
+    *cntbp = b->rbn_size;
+#else
+    uint32_t n = 0;
+
+    rb_min (a, &a);
+    rb_min (b, &b);
+    for (; (a != RB_NIL) && (b != RB_NIL); ++n)
+    {
+        a = rb_next (a);
+        b = rb_next (b);
+    }
+    *cntap = (a == RB_NIL) ? n : total - n;
+    *cntbp = total - *cntap;
+#endif
+}
+
+/**
+ * @brief Join t1, item and t2 into t1; every key of t1 must order below
+ *        item and every key of t2 above it. t2 is left empty.
+ *
+ * O(log n1 + log n2) besides allocating the node for item: both black
+ * heights are measured down the left spines before the shorter tree is
+ * linked in at the matching height.
+ *
+ * @param t1
+ * @param item
+ * @param t2
+ *
+ * @return ROK on success; RFAIL if the trees allocate differently, are
+ *         intrusive or augmented, have live snapshots, or memory runs out
+ *         (both trees are untouched then).
+ */
+rc_t
+rb_join (rb_tree_t  *t1,
+         void       *item,
+         rb_tree_t  *t2)
+{
+    rb_node_t *k;
+    rb_sub_t   t;
+
+    if ((t1->rb_alloc != t2->rb_alloc) ||
+        (t1->rb_alloc == RB_ALLOC_NONE) ||
+        t1->rb_aug || t2->rb_aug ||
+        RB_SNAPS (t1) || RB_SNAPS (t2))
+        return (RFAIL);
+
+    rbn_new (t1, &k, (uintptr_t) item);
+    if (k == NULL)
+        return (RFAIL);
+    (void) rb_adopt (t1, t2);
+
+    t = rb_int_join (rb_tree_sub (t1), k, rb_tree_sub (t2));
+    t1->rb_root  = t.rs_root;
+    t1->rb_cnt  += t2->rb_cnt + 1;
+    t2->rb_root  = RB_NIL;
+    t2->rb_cnt   = 0;
+    return (ROK);
+}
+
+/**
+ * @brief Split tree at item: tree keeps the keys below item, hi receives
+ *        the keys from item up. O(log n) with RB_ORDER_STAT; otherwise
+ *        O(log n + min (n1, n2)), as the smaller half is walked to keep
+ *        the counts right.
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ * @param hi    An empty tree initialised with the same allocation mode.
+ *
+ * @return ROK on success; RFAIL if hi is not empty or allocates
+ *         differently, the tree uses slabs (whose memory cannot be
+ *         divided between two trees) or is augmented, or either has live
+ *         snapshots.
+ */
+rc_t
+rb_split (rb_tree_t  *tree,
+          void       *item,
+          rb_cmp_t    cmp,
+          rb_tree_t  *hi)
+{
+    rb_sub_t   l;
+    rb_sub_t   r;
+    rb_node_t *mid;
+
+    if ((hi->rb_root != RB_NIL) ||
+        (hi->rb_alloc != tree->rb_alloc) ||
+        (tree->rb_alloc == RB_ALLOC_SLAB) ||
+        tree->rb_aug ||
+        RB_SNAPS (tree) || RB_SNAPS (hi))
+        return (RFAIL);
+
+    rb_int_split (rb_tree_sub (tree), item, cmp, -1, &l, &mid, &r);
+    tree->rb_root = l.rs_root;
+    hi->rb_root   = r.rs_root;
+    rb_int_count2 (l.rs_root, r.rs_root, tree->rb_cnt,
+                   &tree->rb_cnt, &hi->rb_cnt);
+    return (ROK);
+}
+
+/**
+ * @brief Remove every key in [lo, hi] at once: split the range out, free
+ *        it, and join what is left. O(log n + k) for k keys removed, with
+ *        one rebalance of the remaining tree, where calling rb_remove()
+ *        per key would rebalance k times.
+ *
+ * @param tree
+ * @param lo
+ * @param hi
+ * @param cmp
+ * @param dtor  Called on the data of each removed node, in key order; may
+ *              be NULL
+ * @param cntp  Receives the number of keys removed; may be NULL
+ *
+ * @return ROK on success; RFAIL if the tree is augmented or has live
+ *         snapshots (nothing is removed then).
+ */
+rc_t
+rb_erase_range (rb_tree_t  *tree,
+                void       *lo,
+                void       *hi,
+                rb_cmp_t    cmp,
+                rb_dtor_t   dtor,
+                uint32_t   *cntp)
+{
+    rb_sub_t   l;
+    rb_sub_t   m;
+    rb_sub_t   r;
+    rb_node_t *mid;
+    uint32_t   cnt = 0;
+
+    if (tree->rb_aug || RB_SNAPS (tree))
+        return (RFAIL);
+
+    if (cmp ((uintptr_t) lo, (uintptr_t) hi) <= 0)
+    {
+        rb_int_split (rb_tree_sub (tree), lo, cmp, -1, &l, &mid, &r);
+        rb_int_split (r, hi, cmp, 1, &m, &mid, &r);
+        cnt = rb_int_destroy (tree, m.rs_root, dtor);
+        tree->rb_root = rb_int_join2 (l, r).rs_root;
+        tree->rb_cnt -= cnt;
+    }
+    if (cntp)
+        *cntp = cnt;
+    return (ROK);
+}
+
+/* Common driver for the set operations below; not for augmented trees or
+ * with live snapshots */
+static rc_t
+rb_setop (rb_tree_t  *t1,
+          rb_tree_t  *t2,
+          rb_cmp_t    cmp,
+          rb_dtor_t   dtor,
+          rb_sub_t  (*op)(rb_setop_t*, rb_sub_t, rb_sub_t))
+{
+    rb_setop_t ctx;
+    rb_sub_t   t;
+    uint32_t   cnt;
+
+    if (t1->rb_aug || t2->rb_aug ||
+        RB_SNAPS (t1) || RB_SNAPS (t2) ||
+        (rb_adopt (t1, t2) != ROK))
+        return (RFAIL);
+
+    ctx.so_tree    = t1;
+    ctx.so_cmp     = cmp;
+    ctx.so_dtor    = dtor;
+    ctx.so_dropped = 0;
+    cnt            = t1->rb_cnt + t2->rb_cnt;
+
+    t = (*op) (&ctx, rb_tree_sub (t1), rb_tree_sub (t2));
+    t1->rb_root = t.rs_root;
+    t1->rb_cnt  = cnt - ctx.so_dropped;
+    t2->rb_root = RB_NIL;
+    t2->rb_cnt  = 0;
+    return (ROK);
+}
+
+/**
+ * @brief t1 = t1 | t2. Where both hold a key, t1's node is kept and t2's
+ *        is freed (its data passed to dtor, if given). t2 is left empty.
+ *
+ * Splits t1 around t2's keys, recursively, and joins the halves back:
+ * O(m log(n/m + 1)) for trees of sizes m <= n, and the recursion is only
+ * as deep as the trees are tall.
+ *
+ * @param t1
+ * @param t2
+ * @param cmp
+ * @param dtor
+ *
+ * @return ROK on success; RFAIL if the trees allocate differently, either
+ *         is augmented or either has live snapshots (both trees are
+ *         untouched then).
+ */
+rc_t
+rb_union (rb_tree_t  *t1,
+          rb_tree_t  *t2,
+          rb_cmp_t    cmp,
+          rb_dtor_t   dtor)
+{
+    return (rb_setop (t1, t2, cmp, dtor, rb_int_union));
+}
+
+/**
+ * @brief t1 = t1 & t2; all other nodes, and all of t2's, are freed.
+ *
+ * @param t1
+ * @param t2
+ * @param cmp
+ * @param dtor
+ *
+ * @return ROK on success; RFAIL if the trees allocate differently, either
+ *         is augmented or either has live snapshots (both trees are
+ *         untouched then).
+ */
+rc_t
+rb_intersect (rb_tree_t  *t1,
+              rb_tree_t  *t2,
+              rb_cmp_t    cmp,
+              rb_dtor_t   dtor)
+{
+    return (rb_setop (t1, t2, cmp, dtor, rb_int_intersect));
+}
+
+/**
+ * @brief t1 = t1 - t2; removed nodes, and all of t2's, are freed.
+ *
+ * @param t1
+ * @param t2
+ * @param cmp
+ * @param dtor
+ *
+ * @return ROK on success; RFAIL if the trees allocate differently, either
+ *         is augmented or either has live snapshots (both trees are
+ *         untouched then).
+ */
+rc_t
+rb_difference (rb_tree_t  *t1,
+               rb_tree_t  *t2,
+               rb_cmp_t    cmp,
+               rb_dtor_t   dtor)
+{
+    return (rb_setop (t1, t2, cmp, dtor, rb_int_difference));
+}
+
+/**
+ * @brief The sentinel returned by the cursor functions at either end.
+ */
+rb_node_t*
+rb_nilp (void)
+{
+    return (RB_NIL);
+}
+
+/**
+ * @brief Smallest node of the tree; RB_NIL if empty.
+ *
+ * @param tree
+ */
+rb_node_t*
+rb_first (rb_tree_t  *tree)
+{
+    rb_node_t *node = RB_NIL;
+
+    if (tree->rb_root != RB_NIL)
+        rb_min (tree->rb_root, &node);
+    return (node);
+}
+
+/**
+ * @brief Largest node of the tree; RB_NIL if empty.
+ *
+ * @param tree
+ */
+rb_node_t*
+rb_last (rb_tree_t  *tree)
+{
+    rb_node_t *node = RB_NIL;
+
+    if (tree->rb_root != RB_NIL)
+        rb_max (tree->rb_root, &node);
+    return (node);
+}
+
+/**
+ * @brief Position a cursor at the first node not less than item. Walk on
+ *        with rb_next()/rb_prev(); a range scan [lo, hi) is
+ *        lower_bound(lo) up to lower_bound(hi) in O(log n + k). A cursor
+ *        stays valid across other inserts and removes, so a scan can stop
+ *        and resume as long as its own node is not removed.
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ *
+ * @return Node, or RB_NIL if every key is less than item
+ */
+rb_node_t*
+rb_lower_bound (rb_tree_t  *tree,
+                void       *item,
+                rb_cmp_t    cmp)
+{
+    return (rb_int_bound (tree->rb_root, item, cmp, 0));
+}
+
+/**
+ * @brief Position a cursor at the first node greater than item.
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ *
+ * @return Node, or RB_NIL if no key is greater than item
+ */
+rb_node_t*
+rb_upper_bound (rb_tree_t  *tree,
+                void       *item,
+                rb_cmp_t    cmp)
+{
+    return (rb_int_bound (tree->rb_root, item, cmp, 1));
+}
+
+#ifdef RB_ORDER_STAT
+/**
+ * @brief Order statistic: the node of rank i (0 based, in key order) in
+ *        O(log n), using the subtree sizes kept in every node.
+ *
+ * @param tree
+ * @param i
+ *
+ * @return Node, or RB_NIL if i >= number of nodes
+ */
+rb_node_t*
+rb_select (rb_tree_t  *tree,
+           uint32_t    i)
+{
+    rb_node_t *node;
+    uint32_t   lsize;
+
+    node = tree->rb_root;
+    while (node != RB_NIL)
     {
-        rb_int_pstorder (root->rbn_left, 
-                          cb, 
-                          visit2);
-        rb_int_pstorder (root->rbn_right, 
-                          cb, 
-                          visit2);
-        (*visit2) (cb, root);
+        lsize = node->rbn_left->rbn_size;
+        if (i == lsize)
+            break;
+        if (i < lsize)
+            node = node->rbn_left;
+        else
+        {
+            i   -= lsize + 1;
+            node = node->rbn_right;
+        }
     }
+    return (node);
 }
 
-/**************************************************************************
- *                                   API                                  *
- **************************************************************************/ 
+/**
+ * @brief Rank of item: how many keys in the tree are less than it, i.e.
+ *        the position item has, or would have, in key order. O(log n).
+ *
+ * @param tree
+ * @param item
+ * @param cmp
+ */
+uint32_t
+rb_rank (rb_tree_t  *tree,
+         void       *item,
+         rb_cmp_t    cmp)
+{
+    rb_node_t *node;
+    uint32_t   rank;
+
+    rank = 0;
+    node = tree->rb_root;
+    while (node != RB_NIL)
+    {
+        if ((*cmp)((uintptr_t) item, node->rbn_data) <= 0)
+            node = node->rbn_left;
+        else
+        {
+            rank += node->rbn_left->rbn_size + 1;
+            node  = node->rbn_right;
+        }
+    }
+    return (rank);
+}
+#endif /* RB_ORDER_STAT */
 
 /**
  * @brief 
  *
- * @param treep
+ * @param tree
+ * @param item
+ * @param cmp
  */
 void
-rb_init (rb_tree_t *tree)
+rb_remove_handle (rb_tree_t  *tree, 
+                  rb_node_t  *node, 
+                  rb_cmp_t    cmp)
 {
-    rb_int_init (&tree->rb_root);
-    tree->rb_cnt = 0;
+    rc_t       rc;
+
+    if (node != RB_NIL)
+    {
+        rc = rb_int_remove (tree, 
+                             node, 
+                             cmp);
+        if (rc == ROK)
+            --tree->rb_cnt;
+    }
+    return; 
 }
 
 /**
  * @brief 
  *
  * @param tree
+ * @param item
+ * @param cmp
  */
 void
-rb_new (rb_tree_t **treep)
+rb_remove (rb_tree_t *tree, 
+           void      *item, 
+           rb_cmp_t   cmp)
 {
-    rb_tree_t *tree;
+    rb_node_t *node = RB_NIL;
 
-    tree = calloc(1, sizeof(*tree));
-    if (tree != NULL)
-        rb_init (tree);
-    *treep = tree;
+    rb_find (tree,
+             item,
+             cmp,
+             &node);
+
+    if (node == RB_NIL)
+    {
+        printf ("Item not found! Not removing..\n");
+        return;
+    }
+
+    rb_remove_handle (tree,
+                      node, 
+                      cmp);
+    return; 
 }
 
-void
-rb_walk  (rb_tree_t       *tree, 
-          rb_trav_order_t  order,
-          void            *cb, 
-          rb_visit_t       visit)
+/*
+ * Images. rb_img_dump lays the records out in key order, so an image
+ * cursor steps by plain index arithmetic; the links let lookups descend
+ * the same tree shape the writer had.
+ */
+
+#define RB_IMG_ORDER    0x01020304u
+
+/* Write node's subtree in order from record *posp + 1; its record index */
+static uint32_t
+rb_img_fill (rb_node_t      *node,
+             rb_img_node_t  *vec,
+             uint32_t       *posp)
 {
-    switch (order)
+    uint32_t idx;
+    uint32_t left;
+
+    if (node == RB_NIL)
+        return (0);
+
+    left                 = rb_img_fill (node->rbn_left, vec, posp);
+    idx                  = ++*posp;
+    vec [idx].rin_data   = node->rbn_data;
+    vec [idx].rin_left   = left;
+    vec [idx].rin_right  = rb_img_fill (node->rbn_right, vec, posp);
+    return (idx);
+}
+
+/**
+ * @brief Write the tree to path as an image that rb_img_open() can map
+ *        back in place. The file is sized up front and filled through a
+ *        shared mapping, so no copy of the tree is built in memory.
+ *
+ * @param tree
+ * @param path  Created, or truncated if it exists
+ *
+ * @return ROK on success; RFAIL on any I/O error.
+ */
+rc_t
+rb_img_dump (rb_tree_t   *tree,
+             const char  *path)
+{
+    rb_img_hdr_t *hdr;
+    void         *map;
+    size_t        len;
+    uint32_t      pos;
+    int           fd;
+    rc_t          rc;
+
+    len = sizeof(*hdr) + ((size_t) tree->rb_cnt + 1) * sizeof(rb_img_node_t);
+    fd  = open (path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return (RFAIL);
+    if (ftruncate (fd, (off_t) len) != 0)
     {
-    default:
-        break;
+        close (fd);
+        return (RFAIL);
+    }
+    map = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close (fd);
+        return (RFAIL);
+    }
 
-    case RB_TRAV_INORDER:
-        rb_int_inorder (tree->rb_root, cb, visit);
-        break;
+    /* ftruncate zero filled the file: record 0, the nil one, is done */
+    hdr = map;
+    memcpy (hdr->rih_magic, RB_IMG_MAGIC, sizeof(hdr->rih_magic));
+    hdr->rih_version = RB_IMG_VERSION;
+    hdr->rih_order   = RB_IMG_ORDER;
+    hdr->rih_cnt     = tree->rb_cnt;
+    pos              = 0;
+    hdr->rih_root    = rb_img_fill (tree->rb_root, 
+                                    (rb_img_node_t*) (hdr + 1), 
+                                    &pos);
+    assert (pos == tree->rb_cnt);
+
+    rc = (msync (map, len, MS_SYNC) == 0) ? ROK : RFAIL;
+    munmap (map, len);
+    if (close (fd) != 0)
+        rc = RFAIL;
+    return (rc);
+}
 
-    case RB_TRAV_PREORDER:
-        rb_int_preorder (tree->rb_root, cb, visit);
-        break;
+/**
+ * @brief Map an image written by rb_img_dump() read-only. Nothing is read
+ *        up front beyond the header: pages come in as lookups touch them.
+ *
+ * @param img
+ * @param path
+ *
+ * @return ROK on success; RFAIL if the file cannot be mapped, or is not an
+ *         image of this version and byte order.
+ */
+rc_t
+rb_img_open (rb_img_t    *img,
+             const char  *path)
+{
+    const rb_img_hdr_t *hdr;
+    struct stat         st;
+    void               *map;
+    int                 fd;
 
-    case RB_TRAV_PSTORDER:
-        rb_int_pstorder (tree->rb_root, cb, visit);
-        break;
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+        return (RFAIL);
+    if ((fstat (fd, &st) != 0) ||
+        ((size_t) st.st_size < sizeof(*hdr) + sizeof(rb_img_node_t)))
+    {
+        close (fd);
+        return (RFAIL);
+    }
+    map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+        return (RFAIL);
 
-#if 0
-    case RB_TRAV_LVLORDER:
-        rb_int_lvlorder2 (tree->rb_root, cb, visit);
-        break;
-#endif
+    hdr = map;
+    if ((memcmp (hdr->rih_magic, RB_IMG_MAGIC, sizeof(hdr->rih_magic)) != 0) ||
+        (hdr->rih_version != RB_IMG_VERSION) ||
+        (hdr->rih_order   != RB_IMG_ORDER) ||
+        (hdr->rih_root    >  hdr->rih_cnt) ||
+        ((size_t) st.st_size != sizeof(*hdr) + ((size_t) hdr->rih_cnt + 1) *
+                                               sizeof(rb_img_node_t)))
+    {
+        munmap (map, st.st_size);
+        return (RFAIL);
+    }
+
+    img->rbi_map   = map;
+    img->rbi_len   = st.st_size;
+    img->rbi_nodes = (const rb_img_node_t*) (hdr + 1);
+    img->rbi_cnt   = hdr->rih_cnt;
+    img->rbi_root  = hdr->rih_root;
+    return (ROK);
+}
+
+/**
+ * @brief Unmap an image; cursors into it are invalid afterwards.
+ *
+ * @param img
+ */
+void
+rb_img_close (rb_img_t  *img)
+{
+    if (img->rbi_map)
+        munmap (img->rbi_map, img->rbi_len);
+    img->rbi_map   = NULL;
+    img->rbi_nodes = NULL;
+    img->rbi_cnt   = 0;
+    img->rbi_root  = 0;
+}
+
+/**
+ * @brief Record holding item, 0 if none.
+ *
+ * @param img
+ * @param item
+ * @param cmp
+ */
+uint32_t
+rb_img_find (const rb_img_t  *img,
+             void            *item,
+             rb_cmp_t         cmp)
+{
+    const rb_img_node_t *rec;
+    uint32_t             i;
+    int                  rc;
+
+    for (i = img->rbi_root; i != 0; )
+    {
+        rec = &img->rbi_nodes [i];
+        rc  = (*cmp)((uintptr_t) item, (uintptr_t) rec->rin_data);
+        if (rc == 0)
+            break;
+        i = (rc < 0) ? rec->rin_left : rec->rin_right;
+    }
+    return (i);
+}
+
+/**
+ * @brief First record whose key is >= item, 0 if none.
+ *
+ * @param img
+ * @param item
+ * @param cmp
+ */
+uint32_t
+rb_img_lower_bound (const rb_img_t  *img,
+                    void            *item,
+                    rb_cmp_t         cmp)
+{
+    const rb_img_node_t *rec;
+    uint32_t             bound;
+    uint32_t             i;
+
+    bound = 0;
+    for (i = img->rbi_root; i != 0; )
+    {
+        rec = &img->rbi_nodes [i];
+        if ((*cmp)((uintptr_t) item, (uintptr_t) rec->rin_data) <= 0)
+        {
+            bound = i;
+            i     = rec->rin_left;
+        }
+        else
+            i     = rec->rin_right;
     }
+    return (bound);
+}
+
+uint32_t
+rb_img_first (const rb_img_t  *img)
+{
+    return ((img->rbi_cnt != 0) ? 1 : 0);
+}
+
+uint32_t
+rb_img_last (const rb_img_t  *img)
+{
+    return (img->rbi_cnt);
+}
+
+uint32_t
+rb_img_next (const rb_img_t  *img,
+             uint32_t         i)
+{
+    return (((i != 0) && (i < img->rbi_cnt)) ? i + 1 : 0);
+}
+
+uint32_t
+rb_img_prev (const rb_img_t  *img,
+             uint32_t         i)
+{
+    (void) img;
+    return ((i != 0) ? i - 1 : 0);
+}
+
+#ifdef RB_SNAPSHOT
+
+/*
+ * Snapshots. Taking one just counts another link to the root; each later
+ * write copies the root-to-node path it changes (see rb_cow), so a
+ * snapshot costs O(1) to take and O(log n) extra per write while it
+ * lives. Readers of a snapshot take no lock and never wait on writers.
+ * They cannot use the parent pointers, which follow the live tree, so
+ * walks keep their own stack.
+ */
+
+#define RB_SNAP_MAX_DEPTH   64          /* >= 2 * log2(2^32) */
+
+/**
+ * @brief Take an immutable snapshot of the tree's current contents.
+ *        Must be serialized with the tree's writers; the snapshot can then
+ *        be read, and released, from any thread.
+ *
+ * The data (keys) are shared, not copied: they must stay valid until the
+ * snapshots referring to them are released. Handles taken before a
+ * snapshot may be replaced by copies on the next write, so look nodes up
+ * again rather than keeping them while snapshots are live. rb_delete()
+ * the tree only after its snapshots are released.
+ *
+ * @param tree  A heap allocated tree (rb_init / rb_new).
+ *
+ * @return The snapshot; NULL for slab or intrusive trees or if out of
+ *         memory.
+ */
+rb_snap_t*
+rb_snapshot (rb_tree_t  *tree)
+{
+    rb_snap_t *snap;
+
+    if (tree->rb_alloc != RB_ALLOC_HEAP)
+        return (NULL);
+    snap = malloc (sizeof(*snap));
+    if (snap == NULL)
+        return (NULL);
+
+    rb_node_ref (tree->rb_root);
+    snap->rsn_root = tree->rb_root;
+    snap->rsn_cnt  = tree->rb_cnt;
+    snap->rsn_tree = tree;
+    __atomic_add_fetch (&tree->rb_snaps, 1, __ATOMIC_RELEASE);
+    return (snap);
 }
 
 /**
- * @brief 
+ * @brief Release a snapshot, freeing the nodes only it still reaches.
  *
- * @param tree
- * @param dtor
+ * @param snapp
  */
 void
-rb_delete (rb_tree_t **treep, 
-           rb_dtor_t   dtor)
+rb_snap_release (rb_snap_t **snapp)
 {
-    rb_tree_t *tree;
+    rb_snap_t *snap;
 
-    if (!treep || !*treep)
+    if (!snapp || !*snapp)
         return;
 
-    tree = *treep;
-    rb_walk (tree, RB_TRAV_PSTORDER, dtor, rbn_delete);
-    free (tree);
-    *treep = NULL;
+    snap = *snapp;
+    rb_node_unref (snap->rsn_root);
+    __atomic_sub_fetch (&snap->rsn_tree->rb_snaps, 1, __ATOMIC_RELEASE);
+    free (snap);
+    *snapp = NULL;
 }
 
-int
-rb_height (rb_tree_t  *tree)
-{
-    return (rb_int_height(tree->rb_root));
-}
 /**
- * @brief 
+ * @brief Look item up in a snapshot.
  *
- * @param tree
+ * @param snap
  * @param item
  * @param cmp
+ * @param datap Receives the stored data (may be NULL)
+ *
+ * @return ROK if found, RFAIL otherwise.
  */
-void
-rb_find (rb_tree_t  *tree, 
-         void       *item, 
-         rb_cmp_t    cmp,
-         rb_node_t **nodep)
+rc_t
+rb_snap_find (rb_snap_t  *snap,
+              void       *item,
+              rb_cmp_t    cmp,
+              uintptr_t  *datap)
 {
+    rb_node_t *node;
 
-    rb_int_find (tree->rb_root,
-                 item,
-                 cmp,
-                 nodep);
-    if (*nodep == RB_NIL)
-        printf ("Item not found!\n");
+    if (rb_int_find (snap->rsn_root, item, cmp, &node) != ROK)
+        return (RFAIL);
+    if (datap)
+        *datap = node->rbn_data;
+    return (ROK);
 }
-        
+
 /**
- * @brief 
+ * @brief In-order walk of a snapshot. The visitor must not change the
+ *        nodes it is handed.
  *
- * @param tree
- * @param item
- * @param cmp
+ * @param snap
+ * @param cb    Passed through to visit
+ * @param visit
  */
 void
-rb_insert (rb_tree_t  *tree, 
-           void       *item, 
-           rb_cmp_t    cmp,
-           rb_node_t **nodep)
+rb_snap_walk (rb_snap_t   *snap,
+              void        *cb,
+              rb_visit_t   visit)
 {
-    rc_t       rc;
+    rb_node_t *stack [RB_SNAP_MAX_DEPTH];
+    rb_node_t *node;
+    int        top;
 
-    rc = rb_int_insert (&tree->rb_root, 
-                        item, 
-                        cmp,
-                        nodep);
-    if (rc == ROK)
-        ++tree->rb_cnt;
-    return; 
+    top  = 0;
+    node = snap->rsn_root;
+    for (;;)
+    {
+        for (; node != RB_NIL; node = node->rbn_left)
+        {
+            assert (top < RB_SNAP_MAX_DEPTH);
+            stack [top++] = node;
+        }
+        if (top == 0)
+            break;
+        node = stack [--top];
+        (*visit) (cb, node);
+        node = node->rbn_right;
+    }
+}
+#endif /* RB_SNAPSHOT */
+
+#ifdef RB_CONCURRENT
+
+/*
+ * Concurrent mode: writers serialize on a mutex, readers take no lock.
+ *
+ * A writer makes rbc_seq odd for the duration of its update and even
+ * again afterwards. A reader samples an even rbc_seq, descends, and keeps
+ * its answer only if rbc_seq is unchanged; otherwise it retries. Readers
+ * therefore never write shared memory and scale with the number of cores.
+ *
+ * The tree always uses slab allocation: removed nodes are recycled
+ * through the free list but their memory is never returned until
+ * rb_cfini(). A freed node keeps its left link and its right link joins
+ * the free list, which ends in RB_NIL rather than NULL, so every link a
+ * racing reader can follow leads to a live, freed or recycled node or to
+ * the sentinel; the sequence check then discards what it found. The descent
+ * is bounded so a torn read cannot send it round in circles. Keys are
+ * handed to the comparator during such a discarded descent too, so
+ * pointer keys must stay readable until no reader can still be looking
+ * at them; by-value keys need no care.
+ */
+
+#define RB_CMAX_DEPTH   128             /* > 2 * log2(2^32) */
+
+static inline void
+rb_cwrite_begin (rb_ctree_t *ct)
+{
+    pthread_mutex_lock (&ct->rbc_wlock);
+    __atomic_store_n (&ct->rbc_seq, ct->rbc_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
 }
 
+static inline void
+rb_cwrite_end (rb_ctree_t *ct)
+{
+    __atomic_store_n (&ct->rbc_seq, ct->rbc_seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock (&ct->rbc_wlock);
+}
 
 /**
- * @brief 
+ * @brief Initialize a tree for lock-free readers and serialized writers.
  *
- * @param tree
+ * @param ct
+ * @param slab_nodes Nodes per slab; 0 selects RB_SLAB_DFLT_NODES.
+ */
+void
+rb_cinit (rb_ctree_t *ct,
+          uint32_t    slab_nodes)
+{
+    rb_init_slab (&ct->rbc_tree, slab_nodes);
+    pthread_mutex_init (&ct->rbc_wlock, NULL);
+    ct->rbc_seq = 0;
+}
+
+/**
+ * @brief Tear down a concurrent tree. No reader or writer may be active.
+ *
+ * @param ct
+ * @param dtor Optional data destructor
+ */
+void
+rb_cfini (rb_ctree_t *ct,
+          rb_dtor_t   dtor)
+{
+    if (dtor)
+        rb_walk (&ct->rbc_tree, RB_TRAV_INORDER, dtor, rbn_dtor);
+    rb_slab_release (&ct->rbc_tree);
+    free (ct->rbc_tree.rb_qbuf);
+    rb_init_slab (&ct->rbc_tree, ct->rbc_tree.rb_slab_nodes);
+    pthread_mutex_destroy (&ct->rbc_wlock);
+}
+
+/**
+ * @brief Lock-free lookup. Safe against concurrent rb_cinsert/rb_cremove.
+ *
+ * @param ct
  * @param item
  * @param cmp
+ * @param datap Data of the matching node, copied out while still valid
+ *
+ * @return ROK if found; RFAIL otherwise
  */
-void
-rb_remove_handle (rb_tree_t  *tree, 
-                  rb_node_t  *node, 
-                  rb_cmp_t    cmp)
+rc_t
+rb_cfind (rb_ctree_t *ct,
+          void       *item,
+          rb_cmp_t    cmp,
+          uintptr_t  *datap)
 {
-    rc_t       rc;
+    rb_node_t *node;
+    uintptr_t  data;
+    uint32_t   seq;
+    int        depth;
+    int        rc;
 
-    if (node != RB_NIL)
+    for (;;)
     {
-        rc = rb_int_remove (&tree->rb_root, 
-                             node, 
-                             cmp);
-        if (rc == ROK)
-            --tree->rb_cnt;
+        seq = __atomic_load_n (&ct->rbc_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;                   /* writer in progress */
+
+        data  = 0;
+        depth = 0;
+        node  = __atomic_load_n (&ct->rbc_tree.rb_root, __ATOMIC_RELAXED);
+        while ((node != RB_NIL) && (depth++ < RB_CMAX_DEPTH))
+        {
+            data = __atomic_load_n (&node->rbn_data, __ATOMIC_RELAXED);
+            rc   = (*cmp)((uintptr_t) item, data);
+            if (rc == 0)
+                break;
+            node = __atomic_load_n ((rc < 0)          ?
+                                        &node->rbn_left :
+                                        &node->rbn_right,
+                                    __ATOMIC_RELAXED);
+        }
+
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+        if ((__atomic_load_n (&ct->rbc_seq, __ATOMIC_RELAXED) == seq) &&
+            (depth <= RB_CMAX_DEPTH))
+            break;
     }
-    return; 
+
+    if (node == RB_NIL)
+        return (RFAIL);
+    if (datap)
+        *datap = data;
+    return (ROK);
 }
 
 /**
- * @brief 
+ * @brief Insert; serialized against other writers, never blocks readers.
  *
- * @param tree
+ * @param ct
  * @param item
  * @param cmp
+ *
+ * @return ROK on success; RFAIL if out of memory
  */
-void
-rb_remove (rb_tree_t *tree, 
-           void      *item, 
-           rb_cmp_t   cmp)
+rc_t
+rb_cinsert (rb_ctree_t *ct,
+            void       *item,
+            rb_cmp_t    cmp)
 {
-    rb_node_t *node = RB_NIL;
+    rb_node_t *node;
 
-    rb_find (tree,
-             item,
-             cmp,
-             &node);
+    rb_cwrite_begin (ct);
+    rb_insert (&ct->rbc_tree, item, cmp, &node);
+    rb_cwrite_end (ct);
+    return ((node != RB_NIL) ? ROK : RFAIL);
+}
 
-    if (node == RB_NIL)
-    {
-        printf ("Item not found! Not removing..\n");
-        return;
-    }
+/**
+ * @brief Remove; serialized against other writers, never blocks readers.
+ *
+ * @param ct
+ * @param item
+ * @param cmp
+ *
+ * @return ROK if an entry was removed; RFAIL if none matched
+ */
+rc_t
+rb_cremove (rb_ctree_t *ct,
+            void       *item,
+            rb_cmp_t    cmp)
+{
+    rb_node_t *node;
 
-    rb_remove_handle (tree,
-                      node, 
-                      cmp);
-    return; 
+    rb_cwrite_begin (ct);
+    rb_int_find (ct->rbc_tree.rb_root, item, cmp, &node);
+    if (node != RB_NIL)
+        rb_remove_handle (&ct->rbc_tree, node, cmp);
+    rb_cwrite_end (ct);
+    return ((node != RB_NIL) ? ROK : RFAIL);
 }
 
+#endif /* RB_CONCURRENT */
+
 #ifdef ETEST
 
+#include "rbtree-template.h"
+
+DEFINE_TEMPLATE_RB(rbi, intptr_t, RB_LESS_SCALAR)
+
 int
 intcmp (uintptr_t a, uintptr_t b)
 {
@@ -760,6 +3184,79 @@ intprint (void *cb __attribute__((unused)), rb_node_t *n)
     printf("%d ", (int) n->rbn_data);
 }
 
+/* Frees each node it is handed, which the walk must not touch again */
+void
+nodefree (void *cb, rb_node_t *n)
+{
+    ++*(int*) cb;
+    free (n);
+}
+
+#define BATCH_KEYS  131072
+
+/* The tree holds key k exactly want [k] times, in key order */
+static int
+batch_matches (rb_tree_t *tp, const uint8_t *want)
+{
+    rb_node_t *x = rb_first (tp);
+    uint32_t   total = 0;
+    int        k, c;
+
+    for (k = 0; k < BATCH_KEYS; ++k)
+        for (c = 0; c < want [k]; ++c, ++total, x = rb_next (x))
+            if ((x == RB_NIL) || (x->rbn_data != (uintptr_t) k))
+                return (0);
+    return ((x == RB_NIL) && (total == tp->rb_cnt));
+}
+
+#ifdef RB_CONCURRENT
+static rb_ctree_t ctree;
+static int        cstop;
+
+void*
+creader (void *arg)
+{
+    uintptr_t data;
+    long      hits = 0;
+    int       i;
+
+    while (!__atomic_load_n (&cstop, __ATOMIC_RELAXED))
+        for (i = 0; i < 4096; ++i)
+            if (rb_cfind (&ctree, (void*) i, intcmp, &data) == ROK)
+            {
+                assert (data == (uintptr_t) i);
+                ++hits;
+            }
+    return ((void*) hits);
+}
+
+/* Even keys below 64 are never removed, odd ones come and go */
+void*
+cchurn_reader (void *arg)
+{
+    uintptr_t data;
+    long      hits = 0;
+    int       i;
+
+    while (!__atomic_load_n (&cstop, __ATOMIC_RELAXED))
+        for (i = 0; i < 64; ++i)
+            if (rb_cfind (&ctree, (void*) i, intcmp, &data) == ROK)
+            {
+                assert (data == (uintptr_t) i);
+                ++hits;
+            }
+            else
+                assert (i & 1);
+    return ((void*) hits);
+}
+#endif
+
+typedef struct conn_
+{
+    int       c_id;
+    rb_node_t c_rbn;
+} conn_t;
+
 int
 main (int argc, char **argv)
 {
@@ -767,7 +3264,7 @@ main (int argc, char **argv)
     rb_node_t *n;
     int        nfound = 0;
     int        found  = 0;
-    int        i;
+    int        i, j;
 
     rb_new (&tp);
 
@@ -809,6 +3306,353 @@ main (int argc, char **argv)
             rb_height (tp));
 
     rb_delete (&tp, NULL);
+
+    /* Same workload with slab allocated nodes */
+    rb_new_slab (&tp, 0);
+    for (i = 0; i <  65536; ++i)
+        rb_insert (tp, (void*) i, intcmp, &n);
+    for (i = 0; i < 65536; i += 2)
+        rb_remove (tp, (void *) i, intcmp);
+    for (i = 0; i < 65536; i += 2)
+        rb_insert (tp, (void*) i, intcmp, &n);
+    printf ("slab tree: %u nodes, height %d\n",
+            tp->rb_cnt, rb_height (tp));
+    rb_delete (&tp, NULL);
+
+    /* Linear time build from sorted input */
+    {
+        void      **items;
+        rb_tree_t  *hi;
+
+        items = calloc (65535, sizeof(*items));
+        for (i = 0; i < 65535; ++i)
+            items [i] = (void*) i;
+        rb_new (&tp);
+        rb_build_sorted (tp, items, 65535);
+        assert (tp->rb_alloc == RB_ALLOC_HEAP);
+        rb_insert (tp, (void*) 65535, intcmp, &n);
+        for (i = 0; i < 65536; i += 3)
+            rb_remove (tp, (void *) i, intcmp);
+        printf ("built tree: %u nodes, height %d\n",
+                tp->rb_cnt, rb_height (tp));
+
+        /* Still a heap tree, so it splits like any other */
+        rb_new (&hi);
+        assert (rb_split (tp, (void*) 32768, intcmp, hi) == ROK);
+        assert ((tp->rb_cnt == 21845) && (hi->rb_cnt == 21845));
+        assert (rb_first (hi)->rbn_data == 32768);
+        rb_delete (&hi, NULL);
+        rb_delete (&tp, NULL);
+        free (items);
+    }
+
+    /* Batched inserts: finger search, then merge and rebuild */
+    {
+        static void    *items [16384];
+        static uint8_t  want [BATCH_KEYS];
+
+        memset (want, 0, sizeof(want));
+        rb_new (&tp);
+        for (i = 0; i < 65536; i += 2)
+        {
+            rb_insert (tp, (void*) i, intcmp, &n);
+            ++want [i];
+        }
+        for (i = 0; i < 1000; ++i)
+        {
+            items [i] = (void*) (((i * 7919) % 1000) * 2 + 1);
+            ++want [(uintptr_t) items [i]];
+        }
+        assert (rb_insert_batch (tp, items, 1000, intcmp) == ROK);
+        assert (batch_matches (tp, want));
+
+        /* Duplicates, 1000 at a time: still finger search */
+        for (i = 0; i < 1000; ++i)
+            items [i] = (void*) (i * 64 + 65536);
+        for (j = 0; j < 16; ++j)
+        {
+            assert (rb_insert_batch (tp, items, 1000, intcmp) == ROK);
+            for (i = 0; i < 1000; ++i)
+                ++want [(uintptr_t) items [i]];
+            assert (batch_matches (tp, want));
+        }
+
+        /* 16384 * RB_BATCH_REBUILD_DIV >= 49768 nodes: merge and rebuild */
+        for (i = 0; i < 16384; ++i)
+        {
+            items [i] = (void*) ((uintptr_t) ((i * 40503) % 16384) * 4 + 1);
+            ++want [(uintptr_t) items [i]];
+        }
+        assert (rb_insert_batch (tp, items, 16384, intcmp) == ROK);
+        assert (batch_matches (tp, want));
+        printf ("batched tree: %u nodes, height %d\n",
+                tp->rb_cnt, rb_height (tp));
+        rb_delete (&tp, NULL);
+    }
+
+    /* Append-mostly keys through the hint, a few stragglers */
+    rb_new (&tp);
+    n = rb_nilp ();
+    for (i = 0; i < 65536; ++i)
+        n = rb_insert_hint (tp, n, (void*) ((i % 64) ? i * 4 : i * 4 - 6),
+                            intcmp);
+    assert (rb_lookup (tp, (void*) 4, intcmp)->rbn_data == 4);
+    assert (rb_lookup (tp, (void*) 5, intcmp) == rb_nilp ());
+    printf ("hinted tree: %u nodes, height %d\n",
+            tp->rb_cnt, rb_height (tp));
+    rb_delete (&tp, NULL);
+
+    /* Level order of a small tree */
+    rb_new (&tp);
+    for (i = 0; i < 15; ++i)
+        rb_insert (tp, (void*) i, intcmp, &n);
+    rb_walk (tp, RB_TRAV_LVLORDER, NULL, intprint);
+    printf ("\n");
+    rb_walk (tp, RB_TRAV_PREORDER, NULL, intprint);
+    printf ("\n");
+    rb_walk (tp, RB_TRAV_PSTORDER, NULL, intprint);
+    printf ("\n");
+    rb_delete (&tp, NULL);
+
+    /* Post-order and level-order walks may free the node they visit */
+    {
+        rb_trav_order_t orders [2] = { RB_TRAV_PSTORDER, RB_TRAV_LVLORDER };
+        int             freed;
+        int             j;
+
+        for (j = 0; j < 2; ++j)
+        {
+            rb_new (&tp);
+            for (i = 0; i < 1000; ++i)
+                rb_insert (tp, (void*) i, intcmp, &n);
+            freed = 0;
+            rb_walk (tp, orders [j], &freed, nodefree);
+            assert (freed == 1000);
+            tp->rb_root = rb_nilp ();
+            tp->rb_cnt  = 0;
+            rb_delete (&tp, NULL);
+        }
+    }
+
+    /* Range scan [1000, 1010) with the cursor API */
+    rb_new (&tp);
+    for (i = 0; i < 4096; i += 2)
+        rb_insert (tp, (void*) i, intcmp, &n);
+    for (n  = rb_lower_bound (tp, (void*) 1001, intcmp);
+         n != rb_nilp () && (int) n->rbn_data < 1010;
+         n  = rb_next (n))
+        intprint (NULL, n);
+    for (n  = rb_upper_bound (tp, (void*) 10, intcmp), n = rb_prev (n);
+         n != rb_nilp ();
+         n  = rb_prev (n))
+        intprint (NULL, n);
+    printf ("\n");
+    assert (rb_first (tp)->rbn_data == 0);
+    assert (rb_last (tp)->rbn_data == 4094);
+    rb_delete (&tp, NULL);
+
+    /* Typed front end with the comparator inlined */
+    rb_new (&tp);
+    for (i = 0; i < 4096; ++i)
+        rbi_insert (tp, (i * 2654435761u) % 8192);
+    for (i = 0; i < 8192; i += 2)
+        rbi_remove (tp, i);
+    assert (rbi_find (tp, 3) != rb_nilp ());
+    assert (rbi_lower_bound (tp, 4) == rb_lower_bound (tp, (void*) 4, rbi_cmp));
+    printf ("typed tree: %u nodes, height %d\n",
+            tp->rb_cnt, rb_height (tp));
+    rb_delete (&tp, NULL);
+
+    /* Set algebra: multiples of 2 and of 3 below 4096 */
+    {
+        rb_tree_t *t2;
+        rb_tree_t *hi;
+
+        rb_new (&tp);
+        rb_new (&t2);
+        rb_new (&hi);
+        for (i = 0; i < 4096; i += 2)
+            rb_insert (tp, (void*) i, intcmp, &n);
+        for (i = 0; i < 4096; i += 3)
+            rb_insert (t2, (void*) i, intcmp, &n);
+        rb_intersect (tp, t2, intcmp, NULL);
+        assert (tp->rb_cnt == 683);
+        rb_split (tp, (void*) 2048, intcmp, hi);
+        assert ((tp->rb_cnt == 342) && (rb_first (hi)->rbn_data == 2052));
+        rb_remove (hi, (void*) 2052, intcmp);
+        rb_join (tp, (void*) 2052, hi);
+        for (i = 0; i < 4096; i += 4)
+            rb_insert (t2, (void*) i, intcmp, &n);
+        rb_difference (t2, tp, intcmp, NULL);
+        printf ("set ops: %u left, height %d\n",
+                t2->rb_cnt, rb_height (t2));
+        rb_delete (&tp, NULL);
+        rb_delete (&t2, NULL);
+        rb_delete (&hi, NULL);
+    }
+
+    /* Range erase: drop [1000, 2999] out of 0..4095 in one go */
+    {
+        uint32_t cnt;
+
+        rb_new_slab (&tp, 256);
+        for (i = 0; i < 4096; ++i)
+            rb_insert (tp, (void*) i, intcmp, &n);
+        rb_erase_range (tp, (void*) 1000, (void*) 2999, intcmp, NULL, &cnt);
+        assert ((cnt == 2000) && (tp->rb_cnt == 2096));
+        assert (rb_next (rb_lookup (tp, (void*) 999, intcmp))->rbn_data == 3000);
+        printf ("range erase: %u left, height %d\n",
+                tp->rb_cnt, rb_height (tp));
+        rb_delete (&tp, NULL);
+    }
+
+    /* Dump to an image and search it in place */
+    {
+        rb_img_t img;
+        uint32_t ii;
+
+        rb_new (&tp);
+        for (i = 0; i < 4096; i += 2)
+            rb_insert (tp, (void*) i, intcmp, &n);
+        if ((rb_img_dump (tp, "/tmp/rbtree-etest.img") == ROK) &&
+            (rb_img_open (&img, "/tmp/rbtree-etest.img") == ROK))
+        {
+            assert (rb_img_find (&img, (void*) 1000, intcmp) != 0);
+            assert (rb_img_find (&img, (void*) 1001, intcmp) == 0);
+            for (ii  = rb_img_lower_bound (&img, (void*) 4085, intcmp);
+                 ii != 0;
+                 ii  = rb_img_next (&img, ii))
+                printf ("%d ", (int) rb_img_data (&img, ii));
+            printf ("\nimage: %u records\n", img.rbi_cnt);
+            rb_img_close (&img);
+            unlink ("/tmp/rbtree-etest.img");
+        }
+        rb_delete (&tp, NULL);
+    }
+
+#ifdef RB_ORDER_STAT
+    /* Percentiles over the even keys 0 .. 4094 */
+    rb_new (&tp);
+    for (i = 0; i < 4096; i += 2)
+        rb_insert (tp, (void*) i, intcmp, &n);
+    for (i = 0; i < 4096; i += 6)
+        rb_remove (tp, (void*) i, intcmp);
+    /* What is left is 6m + 2 and 6m + 4: rank r holds 6 (r/2) + 2 + 2 (r&1) */
+    assert (tp->rb_cnt == 1365);
+    for (i = 0; i < (int) tp->rb_cnt; ++i)
+    {
+        n = rb_select (tp, i);
+        assert (n->rbn_data == (uintptr_t) (6 * (i / 2) + 2 + 2 * (i & 1)));
+        assert (rb_rank (tp, (void*) n->rbn_data, intcmp) == (uint32_t) i);
+    }
+    assert (rb_select (tp, tp->rb_cnt) == RB_NIL);
+    assert (rb_select (tp, tp->rb_cnt / 2)->rbn_data == 2048);
+    assert (rb_select (tp, tp->rb_cnt * 99 / 100)->rbn_data == 4054);
+    assert (rb_rank (tp, (void*) 2000, intcmp) == 666);
+    printf ("p50 %d p99 %d rank(2000) %u\n",
+            (int) rb_select (tp, tp->rb_cnt / 2)->rbn_data,
+            (int) rb_select (tp, tp->rb_cnt * 99 / 100)->rbn_data,
+            rb_rank (tp, (void*) 2000, intcmp));
+    rb_delete (&tp, NULL);
+#endif
+
+#ifdef RB_SNAPSHOT
+    /* A snapshot keeps its contents while the tree is rewritten */
+    {
+        rb_snap_t *snap;
+        uintptr_t  data;
+
+        rb_new (&tp);
+        for (i = 0; i < 4096; ++i)
+            rb_insert (tp, (void*) i, intcmp, &n);
+        snap = rb_snapshot (tp);
+        for (i = 0; i < 4096; i += 2)
+            rb_remove (tp, (void*) i, intcmp);
+        for (i = 4096; i < 8192; ++i)
+            rb_insert (tp, (void*) i, intcmp, &n);
+        assert (rb_snap_find (snap, (void*) 2, intcmp, &data) == ROK);
+        assert (rb_snap_find (snap, (void*) 4096, intcmp, NULL) == RFAIL);
+        printf ("snapshot: %u nodes, tree: %u nodes\n",
+                snap->rsn_cnt, tp->rb_cnt);
+        rb_snap_release (&snap);
+        rb_delete (&tp, NULL);
+    }
+#endif
+
+#ifdef RB_CONCURRENT
+    /* Lock-free readers against a churning writer */
+    {
+        pthread_t tids [4];
+        void     *hits;
+        int       j;
+
+        rb_cinit (&ctree, 0);
+        for (i = 0; i < 4096; i += 2)
+            rb_cinsert (&ctree, (void*) i, intcmp);
+        for (j = 0; j < 4; ++j)
+            pthread_create (&tids [j], NULL, creader, NULL);
+        for (j = 0; j < 64; ++j)
+            for (i = 0; i < 4096; ++i)
+                if (rb_cremove (&ctree, (void*) i, intcmp) != ROK)
+                    rb_cinsert (&ctree, (void*) i, intcmp);
+        __atomic_store_n (&cstop, 1, __ATOMIC_RELAXED);
+        for (j = 0; j < 4; ++j)
+        {
+            pthread_join (tids [j], &hits);
+            printf ("reader %d: %ld hits\n", j, (long) hits);
+        }
+        rb_cfini (&ctree, NULL);
+    }
+
+    /* Small slabs and few keys, so readers keep landing on freed nodes */
+    {
+        pthread_t tids [8];
+        void     *hits;
+        int       j;
+
+        rb_cinit (&ctree, 4);
+        __atomic_store_n (&cstop, 0, __ATOMIC_RELAXED);
+        for (i = 0; i < 64; i += 2)
+            rb_cinsert (&ctree, (void*) i, intcmp);
+        for (j = 0; j < 8; ++j)
+            pthread_create (&tids [j], NULL, cchurn_reader, NULL);
+        for (j = 0; j < 20000; ++j)
+            for (i = 1; i < 64; i += 2)
+                if (rb_cremove (&ctree, (void*) i, intcmp) != ROK)
+                    rb_cinsert (&ctree, (void*) i, intcmp);
+        __atomic_store_n (&cstop, 1, __ATOMIC_RELAXED);
+        for (j = 0; j < 8; ++j)
+        {
+            pthread_join (tids [j], &hits);
+            assert ((long) hits > 0);
+        }
+        printf ("churn: %u nodes, readers never missed a fixed key\n",
+                ctree.rbc_tree.rb_cnt);
+        rb_cfini (&ctree, NULL);
+    }
+#endif
+
+    /* Intrusive tree: nodes live inside conn_t, nothing is allocated */
+    {
+        rb_tree_t  it;
+        conn_t    *conns;
+
+        conns = calloc (1024, sizeof(*conns));
+        rb_init_intrusive (&it);
+        for (i = 0; i < 1024; ++i)
+        {
+            conns [i].c_id = i;
+            rb_node_init (&conns [i].c_rbn, (void*) i);
+            rb_insert_node (&it, &conns [i].c_rbn, intcmp);
+        }
+        rb_int_find (it.rb_root, (void*) 512, intcmp, &n);
+        assert (rb_entry (n, conn_t, c_rbn)->c_id == 512);
+        for (i = 0; i < 1024; i += 2)
+            rb_remove_handle (&it, &conns [i].c_rbn, intcmp);
+        printf ("intrusive tree: %u nodes, height %d\n",
+                it.rb_cnt, rb_height (&it));
+        free (conns);
+    }
     return 0;
 }
 #endif
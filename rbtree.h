@@ -21,11 +21,14 @@
 
 // C_DECL_BEGIN_
 
+#ifndef RC_T_DEFINED_
+#define RC_T_DEFINED_
 typedef enum
 {
     ROK,
     RFAIL
 } rc_t;
+#endif
 
 typedef enum
 {
@@ -42,26 +45,370 @@ typedef enum
     RB_BLACK
 }   rb_color_t;
 
+typedef enum
+{
+    RB_ALLOC_HEAP = 0,          /* calloc/free per node (default)       */
+    RB_ALLOC_SLAB,              /* per-tree slabs with a node free list */
+    RB_ALLOC_NONE               /* intrusive: nodes embedded by caller  */
+}   rb_alloc_t;
+
+#define RB_SLAB_DFLT_NODES  1024
+
 typedef struct rb_node_ rb_node_t;
+typedef struct rb_slab_ rb_slab_t;
 typedef int             (*rb_cmp_t)    (uintptr_t, uintptr_t);
 typedef void            (*rb_dtor_t)   (uintptr_t);
 typedef void            (*rb_visit_t)  (void*, rb_node_t*);
+typedef int             (*rb_augment_t)(rb_node_t*);
 
 struct        rb_node_
 {
     uintptr_t  rbn_data;
     rb_node_t *rbn_left;
     rb_node_t *rbn_right;
+#ifdef RB_PACKED_COLOR
+    uintptr_t  rbn_pc;                  /* parent pointer | red (bit 0)     */
+#else
     rb_node_t *rbn_paren;
     rb_color_t rbn_color;
+#endif
+#ifdef RB_ORDER_STAT
+    uint32_t   rbn_size;                /* nodes in this subtree            */
+#endif
+#ifdef RB_SNAPSHOT
+    uint32_t   rbn_ref;                 /* links to it from all versions    */
+#endif
 };
 
+struct        rb_slab_
+{
+    rb_slab_t *rbs_next;
+    uint32_t   rbs_cnt;                 /* nodes in this slab               */
+    uint32_t   rbs_used;                /* nodes handed out so far          */
+    rb_node_t  rbs_nodes [];
+};
+
+/*
+ * Parent and colour are only reached through these. With RB_PACKED_COLOR
+ * the colour lives in the low bit of the parent pointer (nodes are at least
+ * pointer aligned) and a node is four words; the bit is set for red, so the
+ * all-black sentinel needs no tagging.
+ */
+#ifdef RB_PACKED_COLOR
+#define RB_COLOR_MASK       ((uintptr_t) 1)
+#define rb_paren(n)         ((rb_node_t *) ((n)->rbn_pc & ~RB_COLOR_MASK))
+#define rb_color(n)         (((n)->rbn_pc & RB_COLOR_MASK) ? RB_RED : RB_BLACK)
+#define rb_set_paren(n, p)  ((n)->rbn_pc = (uintptr_t) (p) | \
+                                           ((n)->rbn_pc & RB_COLOR_MASK))
+#define rb_set_color(n, c)  ((n)->rbn_pc = ((n)->rbn_pc & ~RB_COLOR_MASK) | \
+                                           ((c) == RB_RED))
+#else
+#define rb_paren(n)         ((n)->rbn_paren)
+#define rb_color(n)         ((n)->rbn_color)
+#define rb_set_paren(n, p)  ((n)->rbn_paren = (p))
+#define rb_set_color(n, c)  ((n)->rbn_color = (c))
+#endif
+
+/* Container of an embedded node, for intrusive trees (needs stddef.h) */
+#define rb_entry(node, type, member) \
+    ((type *) ((char *) (node) - offsetof (type, member)))
+
 typedef struct rb_tree_
 {
-    rb_node_t *rb_root;
-    uint32_t   rb_cnt;
+    rb_node_t     *rb_root;
+    uint32_t       rb_cnt;
+    rb_alloc_t     rb_alloc;
+    uint32_t       rb_slab_nodes;       /* nodes per slab (RB_ALLOC_SLAB)   */
+    rb_slab_t     *rb_slabs;            /* newest slab first                */
+    rb_node_t     *rb_free;             /* freed nodes by rbn_right, to nil */
+    rb_node_t    **rb_qbuf;             /* level order queue, reused        */
+    uint32_t       rb_qcap;
+    rb_augment_t   rb_aug;              /* see rb_set_augment               */
+#ifdef RB_SNAPSHOT
+    uint32_t       rb_snaps;            /* snapshots not yet released       */
+#endif
 } rb_tree_t;
 
+/*
+ * On-disk image (rb_img_dump): a header followed by one record per node in
+ * key order, links given as record indices and index 0 standing in for
+ * RB_NIL. It holds no pointers, so it can be mapped at any address and
+ * searched in place; keys are stored verbatim, so only trees keyed by
+ * value (not by pointer) survive the trip. Byte order is the writer's.
+ */
+#define RB_IMG_MAGIC        "rbtimg\0"
+#define RB_IMG_VERSION      1
+
+typedef struct rb_img_hdr_
+{
+    char        rih_magic [8];
+    uint32_t    rih_version;
+    uint32_t    rih_order;              /* 0x01020304 in writer's order     */
+    uint32_t    rih_cnt;                /* records 1 .. rih_cnt             */
+    uint32_t    rih_root;
+    uint64_t    rih_pad;
+} rb_img_hdr_t;
+
+typedef struct rb_img_node_
+{
+    uint64_t    rin_data;
+    uint32_t    rin_left;
+    uint32_t    rin_right;
+} rb_img_node_t;
+
+typedef struct rb_img_
+{
+    void                 *rbi_map;
+    size_t                rbi_len;
+    const rb_img_node_t  *rbi_nodes;    /* [0] is the nil record            */
+    uint32_t              rbi_cnt;
+    uint32_t              rbi_root;
+} rb_img_t;
+
+/* Data of image record i (a cursor from the rb_img_* calls, not 0) */
+#define rb_img_data(img, i) ((uintptr_t) (img)->rbi_nodes [(i)].rin_data)
+
+#ifdef RB_SNAPSHOT
+/* 
+ * An immutable version of a heap allocated tree. Writers copy the nodes
+ * they would change while it shares them, so it stays consistent without
+ * any locking; it only supports the rb_snap_* calls below.
+ */
+typedef struct rb_snap_
+{
+    rb_node_t  *rsn_root;
+    uint32_t    rsn_cnt;
+    rb_tree_t  *rsn_tree;
+} rb_snap_t;
+#endif
+
+#ifdef RB_CONCURRENT
+/* Lock-free readers, mutex-serialized writers; needs pthread.h */
+typedef struct rb_ctree_
+{
+    rb_tree_t        rbc_tree;
+    pthread_mutex_t  rbc_wlock;         /* serializes writers               */
+    uint32_t         rbc_seq;           /* odd while a write is in progress */
+} rb_ctree_t;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern void       rb_init           (rb_tree_t   *tree);
+
+extern void       rb_init_slab      (rb_tree_t   *tree,
+                                     uint32_t     slab_nodes);
+
+extern void       rb_init_intrusive (rb_tree_t   *tree);
+
+extern void       rb_set_augment    (rb_tree_t   *tree,
+                                     rb_augment_t aug);
+
+extern void       rb_new            (rb_tree_t  **treep);
+
+extern void       rb_new_slab       (rb_tree_t  **treep,
+                                     uint32_t     slab_nodes);
+
+extern void       rb_delete         (rb_tree_t  **treep, 
+                                     rb_dtor_t    dtor);
+
+extern void       rb_node_init      (rb_node_t   *node,
+                                     void        *item);
+
+extern void       rb_walk           (rb_tree_t   *tree, 
+                                     rb_trav_order_t order,
+                                     void        *cb, 
+                                     rb_visit_t   visit);
+
+extern int        rb_height         (rb_tree_t   *tree);
+
+extern void       rb_find           (rb_tree_t   *tree, 
+                                     void        *item, 
+                                     rb_cmp_t     cmp,
+                                     rb_node_t  **nodep);
+
+extern rb_node_t* rb_lookup         (rb_tree_t   *tree,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+
+extern void       rb_insert         (rb_tree_t   *tree, 
+                                     void        *item, 
+                                     rb_cmp_t     cmp,
+                                     rb_node_t  **nodep);
+
+extern rb_node_t* rb_insert_hint    (rb_tree_t   *tree,
+                                     rb_node_t   *hint,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+
+extern void       rb_insert_node    (rb_tree_t   *tree, 
+                                     rb_node_t   *node, 
+                                     rb_cmp_t     cmp);
+
+extern void       rb_link_at        (rb_tree_t   *tree,
+                                     rb_node_t   *paren,
+                                     int          dir,
+                                     rb_node_t   *node);
+
+extern rb_node_t* rb_insert_at      (rb_tree_t   *tree,
+                                     rb_node_t   *paren,
+                                     int          dir,
+                                     void        *item);
+
+extern rc_t       rb_build_sorted   (rb_tree_t   *tree,
+                                     void       **items,
+                                     uint32_t     n);
+
+extern rc_t       rb_insert_batch   (rb_tree_t   *tree,
+                                     void       **items,
+                                     uint32_t     n,
+                                     rb_cmp_t     cmp);
+
+/* Join, split and set algebra; the second tree is left empty */
+
+extern rc_t       rb_join           (rb_tree_t   *t1,
+                                     void        *item,
+                                     rb_tree_t   *t2);
+
+extern rc_t       rb_split          (rb_tree_t   *tree,
+                                     void        *item,
+                                     rb_cmp_t     cmp,
+                                     rb_tree_t   *hi);
+
+extern rc_t       rb_erase_range    (rb_tree_t   *tree,
+                                     void        *lo,
+                                     void        *hi,
+                                     rb_cmp_t     cmp,
+                                     rb_dtor_t    dtor,
+                                     uint32_t    *cntp);
+
+extern rc_t       rb_union          (rb_tree_t   *t1,
+                                     rb_tree_t   *t2,
+                                     rb_cmp_t     cmp,
+                                     rb_dtor_t    dtor);
+
+extern rc_t       rb_intersect      (rb_tree_t   *t1,
+                                     rb_tree_t   *t2,
+                                     rb_cmp_t     cmp,
+                                     rb_dtor_t    dtor);
+
+extern rc_t       rb_difference     (rb_tree_t   *t1,
+                                     rb_tree_t   *t2,
+                                     rb_cmp_t     cmp,
+                                     rb_dtor_t    dtor);
+
+extern void       rb_remove_handle  (rb_tree_t   *tree, 
+                                     rb_node_t   *node, 
+                                     rb_cmp_t     cmp);
+
+extern void       rb_remove         (rb_tree_t   *tree, 
+                                     void        *item, 
+                                     rb_cmp_t     cmp);
+
+/* Cursors: ordered traversal from any node, RB_NIL (rb_nilp) at the ends */
+
+extern rb_node_t* rb_nilp           (void);
+
+extern rb_node_t* rb_first          (rb_tree_t   *tree);
+
+extern rb_node_t* rb_last           (rb_tree_t   *tree);
+
+extern rb_node_t* rb_next           (rb_node_t   *node);
+
+extern rb_node_t* rb_prev           (rb_node_t   *node);
+
+extern rb_node_t* rb_lower_bound    (rb_tree_t   *tree,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+
+extern rb_node_t* rb_upper_bound    (rb_tree_t   *tree,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+
+/* Images: cursors are record indices, 0 past either end */
+
+extern rc_t       rb_img_dump       (rb_tree_t   *tree,
+                                     const char  *path);
+
+extern rc_t       rb_img_open       (rb_img_t    *img,
+                                     const char  *path);
+
+extern void       rb_img_close      (rb_img_t    *img);
+
+extern uint32_t   rb_img_find       (const rb_img_t *img,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+
+extern uint32_t   rb_img_lower_bound(const rb_img_t *img,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+
+extern uint32_t   rb_img_first      (const rb_img_t *img);
+
+extern uint32_t   rb_img_last       (const rb_img_t *img);
+
+extern uint32_t   rb_img_next       (const rb_img_t *img,
+                                     uint32_t     i);
+
+extern uint32_t   rb_img_prev       (const rb_img_t *img,
+                                     uint32_t     i);
+
+#ifdef RB_ORDER_STAT
+/* Order statistics; build every user of rbtree.h with -DRB_ORDER_STAT */
+
+extern rb_node_t* rb_select         (rb_tree_t   *tree,
+                                     uint32_t     i);
+
+extern uint32_t   rb_rank           (rb_tree_t   *tree,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+#endif
+
+#ifdef RB_SNAPSHOT
+/* Snapshots; build every user of rbtree.h with -DRB_SNAPSHOT */
+
+extern rb_snap_t* rb_snapshot       (rb_tree_t   *tree);
+
+extern void       rb_snap_release   (rb_snap_t  **snapp);
+
+extern rc_t       rb_snap_find      (rb_snap_t   *snap,
+                                     void        *item,
+                                     rb_cmp_t     cmp,
+                                     uintptr_t   *datap);
+
+extern void       rb_snap_walk      (rb_snap_t   *snap,
+                                     void        *cb,
+                                     rb_visit_t   visit);
+#endif
+
+#ifdef RB_CONCURRENT
+/* Concurrent mode; build every user of rbtree.h with -DRB_CONCURRENT */
+
+extern void       rb_cinit          (rb_ctree_t  *ct,
+                                     uint32_t     slab_nodes);
+
+extern void       rb_cfini          (rb_ctree_t  *ct,
+                                     rb_dtor_t    dtor);
+
+extern rc_t       rb_cfind          (rb_ctree_t  *ct,
+                                     void        *item,
+                                     rb_cmp_t     cmp,
+                                     uintptr_t   *datap);
+
+extern rc_t       rb_cinsert        (rb_ctree_t  *ct,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+
+extern rc_t       rb_cremove        (rb_ctree_t  *ct,
+                                     void        *item,
+                                     rb_cmp_t     cmp);
+#endif
+#ifdef __cplusplus
+}
+#endif
+
 // C_DECL_END_
 
 #endif /* RB_TREE_H_ */
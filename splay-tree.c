@@ -152,6 +152,372 @@ splay (splay_node_t*      root,
     RETVAL(node);
 }
 
+/**
+ * @brief Splay the smallest node to the root. The direction is always
+ *        left, so no comparisons are needed; the new root has no left
+ *        child.
+ *
+ * @param root Current root of the splay tree; not NIL
+ * @param nilp Sentinel NIL
+ *
+ * @return The new root
+ */
+static splay_node_t*
+splay_leftmost (splay_node_t* root,
+                splay_node_t* nilp)
+{
+    splay_node_t  dummy;
+    splay_node_t* right;
+    splay_node_t* next;
+
+    right = &dummy;
+    while (root->splay_left != nilp)
+    {
+        next = root->splay_left;
+        if (next->splay_left != nilp)
+        {
+            /* Rotate right */
+
+            root->splay_left  = next->splay_right;
+            next->splay_right = root;
+            root              = next;
+        }
+
+        /* link right */
+
+        right->splay_left = root;
+        right             = root;
+        root              = root->splay_left;
+    }
+    right->splay_left = root->splay_right;
+    root->splay_right = dummy.splay_left;
+    RETVAL (root);
+}
+
+/**
+ * @brief The mirror of splay_leftmost(): the largest node becomes the
+ *        root, with no right child.
+ *
+ * @param root Current root of the splay tree; not NIL
+ * @param nilp Sentinel NIL
+ *
+ * @return The new root
+ */
+static splay_node_t*
+splay_rightmost (splay_node_t* root,
+                 splay_node_t* nilp)
+{
+    splay_node_t  dummy;
+    splay_node_t* left;
+    splay_node_t* next;
+
+    left = &dummy;
+    while (root->splay_right != nilp)
+    {
+        next = root->splay_right;
+        if (next->splay_right != nilp)
+        {
+            /* Rotate left */
+
+            root->splay_right = next->splay_left;
+            next->splay_left  = root;
+            root              = next;
+        }
+
+        /* Link left */
+
+        left->splay_right = root;
+        left              = root;
+        root              = root->splay_right;
+    }
+    left->splay_right = root->splay_left;
+    root->splay_left  = dummy.splay_right;
+    RETVAL (root);
+}
+
+/**
+ * @brief Split at key: splay it (or its neighbour) to the root, then cut
+ *        the root off on one side. O(log n) amortized.
+ *
+ * @param root  Current root of the splay tree
+ * @param nilp  Sentinel NIL
+ * @param comp  Comparator
+ * @param key   Where to split
+ * @param incl  Nonzero to send a key equal to key to the low side
+ * @param lop   Receives the keys below key (and equal, with incl)
+ * @param hip   Receives the rest
+ */
+static void
+splay_int_split (splay_node_t*      root,
+                 splay_node_t*      nilp,
+                 splay_comparator_t comp,
+                 void*              key,
+                 int                incl,
+                 splay_node_t**     lop,
+                 splay_node_t**     hip)
+{
+    int rc;
+
+    if (root == nilp)
+    {
+        *lop = nilp;
+        *hip = nilp;
+        RETVOID;
+    }
+
+    root = splay (root, nilp, key, comp);
+    rc   = (*comp) (key, root->splay_item);
+    if ((rc > 0) || ((rc == 0) && incl))
+    {
+        *hip              = root->splay_right;
+        root->splay_right = nilp;
+        *lop              = root;
+    }
+    else
+    {
+        *lop              = root->splay_left;
+        root->splay_left  = nilp;
+        *hip              = root;
+    }
+}
+
+/*
+ * Paths longer than this are splayed fully instead of semi-splayed; a path
+ * that long is where the full splay's restructuring pays for itself.
+ */
+#define SPLAY_SEMI_MAX_DEPTH    128
+
+/**
+ * @brief Bottom-up semi-splaying (Sleator & Tarjan) along the search path
+ *        of key. The path is kept as the links that lead to each node, so
+ *        no parent pointers are needed.
+ *
+ * @param rootp Address of the root pointer
+ * @param nilp  Sentinel NIL
+ * @param key   Key value searched for
+ * @param comp  Comparator
+ *
+ * @return The node holding key, or the last node on the path; it is
+ *         not necessarily the new root.
+ */
+static splay_node_t*
+splay_semi (splay_node_t**     rootp,
+            splay_node_t*      nilp,
+            void*              key,
+            splay_comparator_t comp)
+{
+    splay_node_t** links [SPLAY_SEMI_MAX_DEPTH];
+    splay_node_t** link;
+    splay_node_t*  node;
+    splay_node_t*  parent;
+    splay_node_t*  grand;
+    splay_node_t*  found;
+    int            depth;
+    int            rc;
+
+    depth = 0;
+    link  = rootp;
+    for (;;)
+    {
+        node = *link;
+        if (depth == SPLAY_SEMI_MAX_DEPTH)
+        {
+            *rootp = splay (*rootp, nilp, key, comp);
+            RETVAL (*rootp);
+        }
+        links [depth] = link;
+        rc            = (*comp) (key, node->splay_item);
+        if (rc == 0)
+            break;
+        link = (rc < 0) ? &node->splay_left : &node->splay_right;
+        if (*link == nilp)
+            break;
+        ++depth;
+    }
+
+    /* node is *links [depth]; climb two levels per step */
+    found = node;
+    while (depth >= 2)
+    {
+        parent = *links [depth - 1];
+        grand  = *links [depth - 2];
+
+        if ((grand->splay_left == parent) == (parent->splay_left == node))
+        {
+            /* Zig-zig: rotate parent over grand, continue from parent */
+            if (parent->splay_left == node)
+            {
+                grand->splay_left   = parent->splay_right;
+                parent->splay_right = grand;
+            }
+            else
+            {
+                grand->splay_right  = parent->splay_left;
+                parent->splay_left  = grand;
+            }
+            *links [depth - 2] = parent;
+            node               = parent;
+        }
+        else
+        {
+            /* Zig-zag: node replaces grand, as in a full splay */
+            if (parent->splay_right == node)
+            {
+                parent->splay_right = node->splay_left;
+                grand->splay_left   = node->splay_right;
+                node->splay_left    = parent;
+                node->splay_right   = grand;
+            }
+            else
+            {
+                parent->splay_left  = node->splay_right;
+                grand->splay_right  = node->splay_left;
+                node->splay_right   = parent;
+                node->splay_left    = grand;
+            }
+            *links [depth - 2] = node;
+        }
+        depth -= 2;
+    }
+
+    RETVAL (found);
+}
+
+/**
+ * @brief Plain binary search; the tree is not written to.
+ *
+ * @param root   Root of the splay tree
+ * @param nilp   Sentinel NIL
+ * @param key    Key value searched for
+ * @param comp   Comparator
+ * @param depthp Receives the depth of the node found (root is 0)
+ *
+ * @return The node holding key; NIL if there is none.
+ */
+static splay_node_t*
+splay_lookup (splay_node_t*      root,
+              splay_node_t*      nilp,
+              void*              key,
+              splay_comparator_t comp,
+              uint32_t*          depthp)
+{
+    uint32_t depth = 0;
+    int      rc;
+
+    while (root != nilp)
+    {
+        rc = (*comp) (key, root->splay_item);
+        if (rc == 0)
+            break;
+        root = (rc < 0) ? root->splay_left : root->splay_right;
+        ++depth;
+    }
+    *depthp = depth;
+    RETVAL (root);
+}
+
+/* Hang child off owner through link; the sentinel's parent is never set */
+#define SPLAY_HEAP_LINK(link, owner, child)                                 \
+    do {                                                                    \
+        *(link) = (child);                                                  \
+        if ((child) != splay_NILP)                                          \
+            (child)->splay_parent = (owner);                                \
+    } while (0)
+
+static splay_node_t*
+splay_heap_leftmost (splay_node_t* node)
+{
+    while (node->splay_left != splay_NILP)
+        node = node->splay_left;
+    RETVAL (node);
+}
+
+/**
+ * @brief Okasaki's partition, top-down: split the tree at root into the
+ *        keys not above node's key and those above it, and hang them off
+ *        node. Runs of two steps the same way are rotated, as in a splay,
+ *        which is what keeps inserts O(log n) amortized.
+ *
+ * @param root Current root
+ * @param node New root; its key is the pivot
+ * @param comp Comparator
+ */
+static void
+splay_heap_partition (splay_node_t*      root,
+                      splay_node_t*      node,
+                      splay_comparator_t comp)
+{
+    splay_node_t** small  = &node->splay_left;
+    splay_node_t** big    = &node->splay_right;
+    splay_node_t*  sowner = node;
+    splay_node_t*  bowner = node;
+    splay_node_t*  next;
+    void*          pivot  = node->splay_item;
+
+    while (root != splay_NILP)
+    {
+        if ((*comp) (root->splay_item, pivot) <= 0)
+        {
+            next = root->splay_right;
+            if ((next != splay_NILP) && 
+                ((*comp) (next->splay_item, pivot) <= 0))
+            {
+                /* Rotate left */
+                SPLAY_HEAP_LINK (&root->splay_right, root, next->splay_left);
+                next->splay_left   = root;
+                root->splay_parent = next;
+                root               = next;
+            }
+
+            /* Link small */
+            SPLAY_HEAP_LINK (small, sowner, root);
+            small  = &root->splay_right;
+            sowner = root;
+            root   = root->splay_right;
+        }
+        else
+        {
+            next = root->splay_left;
+            if ((next != splay_NILP) && 
+                ((*comp) (next->splay_item, pivot) > 0))
+            {
+                /* Rotate right */
+                SPLAY_HEAP_LINK (&root->splay_left, root, next->splay_right);
+                next->splay_right  = root;
+                root->splay_parent = next;
+                root               = next;
+            }
+
+            /* Link big */
+            SPLAY_HEAP_LINK (big, bowner, root);
+            big    = &root->splay_left;
+            bowner = root;
+            root   = root->splay_left;
+        }
+    }
+    *small = splay_NILP;
+    *big   = splay_NILP;
+}
+
+/* Unlink node, which has no left child, putting its right subtree there */
+static void
+splay_heap_unlink (splay_heap_t* heap,
+                   splay_node_t* node)
+{
+    splay_node_t* parent = node->splay_parent;
+
+    if (parent == NULL)
+    {
+        heap->sh_root = node->splay_right;
+        if (heap->sh_root != splay_NILP)
+            heap->sh_root->splay_parent = NULL;
+    }
+    else if (parent->splay_left == node)
+        SPLAY_HEAP_LINK (&parent->splay_left, parent, node->splay_right);
+    else
+        SPLAY_HEAP_LINK (&parent->splay_right, parent, node->splay_right);
+}
+
 /****************************************************************************
  *                       PUBLIC variables and functions                     *
  ****************************************************************************/
@@ -390,6 +756,73 @@ splay_find (splay_node_t**     splay_rootp,
                              root->splay_item) == 0) ? root : nilp);
 }
 
+/**
+ * @brief splay_find() with a choice of how much the lookup restructures
+ *        the tree; see splay_mode_t. Read-mostly workloads keep most of
+ *        the self-adjusting benefit on skewed access from SPLAY_DEPTH or
+ *        SPLAY_PROB while most hits write nothing.
+ *
+ * @param splay_rootp Pointer to the address of splay tree.
+ * @param nilp        Sentinal NIL to the splay tree
+ * @param splay_comp  Comparator
+ * @param item        The 'key' to be looked up.
+ * @param policy      NULL for SPLAY_FULL. SPLAY_PROB updates sp_seed, so
+ *                    give each thread its own policy.
+ *
+ * @return            Pointer to the splay node if the item stored in it
+ *                    exists; NIL otherwise
+ */
+splay_node_t*
+splay_find_policy (splay_node_t**     splay_rootp, 
+                   splay_node_t*      nilp, 
+                   splay_comparator_t splay_comp,
+                   void*              item,
+                   splay_policy_t*    policy)
+{
+    splay_node_t* node;
+    uint32_t      depth;
+    uint32_t      x;
+
+    if (*splay_rootp == nilp)
+        RETVAL (nilp);
+
+    switch ((policy) ? policy->sp_mode : SPLAY_FULL)
+    {
+    case SPLAY_SEMI:
+        node = splay_semi (splay_rootp, nilp, item, splay_comp);
+        break;
+
+    case SPLAY_DEPTH:
+        node = splay_lookup (*splay_rootp, nilp, item, splay_comp, &depth);
+        if ((node == nilp) || (depth <= policy->sp_depth))
+            RETVAL (node);
+        node = splay (*splay_rootp, nilp, item, splay_comp);
+        *splay_rootp = node;
+        break;
+
+    case SPLAY_PROB:
+        /* xorshift32 */
+        x  = policy->sp_seed;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        policy->sp_seed = x;
+        if ((x & 0xffff) >= policy->sp_prob)
+            RETVAL (splay_lookup (*splay_rootp, nilp, item, splay_comp, 
+                                  &depth));
+        /* Fall through */
+
+    case SPLAY_FULL:
+    default:
+        node = splay (*splay_rootp, nilp, item, splay_comp);
+        *splay_rootp = node;
+        break;
+    }
+
+    RETVAL ( ((*splay_comp) (item, 
+                             node->splay_item) == 0) ? node : nilp);
+}
+
 /**
  * @brief Implements the 'delete-min' priority queue operation using a splay
  *        tree.
@@ -406,19 +839,17 @@ splay_delete_min (splay_node_t**     splay_rootp,
                   splay_node_t*      nilp, 
                   splay_comparator_t splay_comp)
 {
-    splay_node_t* curr;
     splay_node_t* node;
 
-    node = nilp;
-    curr = *splay_rootp;
-    while (curr != nilp)
-    {
-        node = curr;
-        curr = curr->splay_left;
-    }
-    if (node != nilp) {
-        node = splay_remove (splay_rootp, nilp, splay_comp, node);
-    }
+    node = *splay_rootp;
+    if (node == nilp)
+        RETVAL (nilp);
+
+    /* No comparisons: the minimum comes up with no left child */
+    node         = splay_leftmost (node, nilp);
+    *splay_rootp = node->splay_right;
+
+    splay_node_init (node, NULL);
     RETVAL (node);
 }
 
@@ -454,6 +885,269 @@ splay_decrease_key (splay_node_t**     splay_rootp,
     RETVAL(nilp);
 }
 
+/**
+ * @brief Cut a splay tree in two at key; O(log n) amortized.
+ *
+ * @param root       Root of the splay tree; it is consumed
+ * @param nilp       Sentinel NIL
+ * @param splay_comp Comparator
+ * @param key        Where to split
+ * @param lop        Receives a tree of the keys below key
+ * @param hip        Receives a tree of the keys from key on
+ */
+void
+splay_split (splay_node_t*      root,
+             splay_node_t*      nilp,
+             splay_comparator_t splay_comp,
+             void*              key,
+             splay_node_t**     lop,
+             splay_node_t**     hip)
+{
+    splay_int_split (root, nilp, splay_comp, key, 0, lop, hip);
+}
+
+/**
+ * @brief Concatenate two splay trees; O(log n) amortized, and no
+ *        comparisons. The largest key of lo splays to the root, which
+ *        then has no right child to take hi.
+ *
+ * @param lo   Every key in it must be below every key in hi
+ * @param hi
+ * @param nilp Sentinel NIL
+ *
+ * @return Root of the joined tree
+ */
+splay_node_t*
+splay_join (splay_node_t* lo,
+            splay_node_t* hi,
+            splay_node_t* nilp)
+{
+    if (lo == nilp)
+        RETVAL (hi);
+    lo              = splay_rightmost (lo, nilp);
+    lo->splay_right = hi;
+    RETVAL (lo);
+}
+
+/**
+ * @brief Take every key in [lo, hi] out of the tree at once: two splits
+ *        and a join, so O(log n) amortized however many keys go.
+ *
+ * @param splay_rootp Pointer to the address of splay tree.
+ * @param nilp        Sentinal NIL to the splay tree
+ * @param splay_comp  Comparator
+ * @param lo          Smallest key to take
+ * @param hi          Largest key to take
+ *
+ * @return            A splay tree of the nodes taken (NIL if none); they
+ *                    are the caller's, as with splay_remove().
+ */
+splay_node_t*
+splay_remove_range (splay_node_t**     splay_rootp, 
+                    splay_node_t*      nilp, 
+                    splay_comparator_t splay_comp,
+                    void*              lo,
+                    void*              hi)
+{
+    splay_node_t* below;
+    splay_node_t* range;
+    splay_node_t* above;
+
+    splay_int_split (*splay_rootp, nilp, splay_comp, lo, 0, &below, &range);
+    splay_int_split (range, nilp, splay_comp, hi, 1, &range, &above);
+    *splay_rootp = splay_join (below, above, nilp);
+
+    RETVAL (range);
+}
+
+/**
+ * @brief Move every key in [lo, hi] from one tree to another. The keys
+ *        go in as one piece, so the destination may have none of its own
+ *        in [lo, hi]; O(log n) amortized.
+ *
+ * @param srcp        Pointer to the address of the tree to take from
+ * @param dstp        Pointer to the address of the tree to add to
+ * @param nilp        Sentinal NIL
+ * @param splay_comp  Comparator
+ * @param lo          Smallest key to move
+ * @param hi          Largest key to move
+ *
+ * @return            ROK; RFAIL, with both trees unchanged, if the
+ *                    destination has a key in [lo, hi].
+ */
+rc_t
+splay_move_range (splay_node_t**     srcp, 
+                  splay_node_t**     dstp, 
+                  splay_node_t*      nilp, 
+                  splay_comparator_t splay_comp,
+                  void*              lo,
+                  void*              hi)
+{
+    splay_node_t* below;
+    splay_node_t* above;
+    splay_node_t* range;
+
+    splay_int_split (*dstp, nilp, splay_comp, lo, 0, &below, &above);
+    if (above != nilp)
+    {
+        above = splay_leftmost (above, nilp);
+        if ((*splay_comp) (above->splay_item, hi) <= 0)
+        {
+            *dstp = splay_join (below, above, nilp);
+            RETVAL (RFAIL);
+        }
+    }
+
+    range = splay_remove_range (srcp, nilp, splay_comp, lo, hi);
+    *dstp = splay_join (splay_join (below, range, nilp), above, nilp);
+
+    RETVAL (ROK);
+}
+
+/**
+ * @brief Make an empty splay heap.
+ *
+ * @param heap
+ */
+void
+splay_heap_init (splay_heap_t* heap)
+{
+    heap->sh_root  = splay_NILP;
+    heap->sh_min   = splay_NILP;
+    heap->sh_count = 0;
+}
+
+/**
+ * @brief            Insert a node; O(log n) amortized. The node becomes
+ *                   the root.
+ *
+ * @param heap
+ * @param splay_comp Comparator
+ * @param node       Splay node containing the pointer to item/key.
+ */
+void
+splay_heap_insert (splay_heap_t*      heap,
+                   splay_comparator_t splay_comp,
+                   splay_node_t*      node)
+{
+    assert (node && node->splay_item);
+
+    splay_heap_partition (heap->sh_root, node, splay_comp);
+    node->splay_parent = NULL;
+    heap->sh_root      = node;
+    if ((heap->sh_min == splay_NILP) ||
+        ((*splay_comp) (node->splay_item, heap->sh_min->splay_item) < 0))
+        heap->sh_min = node;
+    ++heap->sh_count;
+}
+
+/**
+ * @brief  Peek at the minimum; O(1).
+ *
+ * @param heap
+ *
+ * @return The node with the smallest key; NIL if the heap is empty.
+ */
+splay_node_t*
+splay_heap_min (splay_heap_t* heap)
+{
+    RETVAL (heap->sh_min);
+}
+
+/**
+ * @brief  Remove the minimum. The cached minimum has no left child, so
+ *         it is unlinked where it is, with no comparisons; the next one
+ *         is its parent or the leftmost node of its right subtree.
+ *
+ * @param heap
+ *
+ * @return The node removed; NIL if the heap is empty.
+ */
+splay_node_t*
+splay_heap_delete_min (splay_heap_t* heap)
+{
+    splay_node_t* node;
+
+    node = heap->sh_min;
+    if (node == splay_NILP)
+        RETVAL (node);
+
+    splay_heap_unlink (heap, node);
+    if (node->splay_right != splay_NILP)
+        heap->sh_min = splay_heap_leftmost (node->splay_right);
+    else if (node->splay_parent != NULL)
+        heap->sh_min = node->splay_parent;
+    else
+        heap->sh_min = splay_NILP;
+    --heap->sh_count;
+
+    splay_node_init (node, NULL);
+    node->splay_parent = NULL;
+    RETVAL (node);
+}
+
+/**
+ * @brief            Lower a node's key. If the node's in-order predecessor
+ *                   is still not above the new key nothing moves: the key
+ *                   is just replaced. Otherwise the node is cut out and
+ *                   inserted again.
+ *
+ * @param heap
+ * @param splay_comp Comparator
+ * @param node       A node in the heap
+ * @param newkey     Not above the current key
+ */
+void
+splay_heap_decrease_key (splay_heap_t*      heap,
+                         splay_comparator_t splay_comp,
+                         splay_node_t*      node,
+                         void*              newkey)
+{
+    splay_node_t* pred;
+    splay_node_t* prev;
+
+    /* Find the in-order predecessor, if any */
+    if (node->splay_left != splay_NILP)
+    {
+        for (pred = node->splay_left; 
+             pred->splay_right != splay_NILP; 
+             pred = pred->splay_right)
+            ;
+    }
+    else
+    {
+        for (prev = node, pred = node->splay_parent; 
+             (pred != NULL) && (pred->splay_left == prev);
+             prev = pred, pred = pred->splay_parent)
+            ;
+    }
+
+    if ((pred == NULL) || 
+        ((*splay_comp) (pred->splay_item, newkey) <= 0))
+    {
+        node->splay_item = newkey;
+        RETVOID;
+    }
+
+    /* 
+     * Cut it out. With a left subtree, the right one goes under the
+     * predecessor, its rightmost node, which leaves node with only one
+     * child to hand to its parent.
+     */
+    if (node->splay_left != splay_NILP)
+    {
+        SPLAY_HEAP_LINK (&pred->splay_right, pred, node->splay_right);
+        node->splay_right = node->splay_left;
+        node->splay_left  = splay_NILP;
+    }
+    splay_heap_unlink (heap, node);
+
+    node->splay_item  = newkey;
+    node->splay_left  = splay_NILP;
+    node->splay_right = splay_NILP;
+    --heap->sh_count;
+    splay_heap_insert (heap, splay_comp, node);
+}
 
 /****************************************************************************
  *                               API TEST *                                 *
@@ -466,6 +1160,19 @@ int intcomp (void* a, void* b)
     RETVAL (*(int*)a - *(int*)b);
 }
 
+/* Nodes in the subtree; asserts that its keys are in order within [lo, hi) */
+int splay_check (splay_node_t* node, int lo, int hi)
+{
+    int key;
+
+    if (node == splay_NILP)
+        RETVAL (0);
+    key = *(int*)node->splay_item;
+    assert ((key >= lo) && (key < hi));
+    RETVAL (splay_check (node->splay_left, lo, key) + 1 +
+            splay_check (node->splay_right, key + 1, hi));
+}
+
 int main (int argc, char* argv [])
 {
     splay_node_t* root;
@@ -475,6 +1182,7 @@ int main (int argc, char* argv [])
     int count;
     int i;
     unsigned int   seed;
+    splay_policy_t policy = { SPLAY_FULL, 8, 4096, 1 };
 
     count = 0;
     if (argc > 1) 
@@ -526,6 +1234,63 @@ int main (int argc, char* argv [])
 #endif
     }
 
+    /* Every policy must find what splay_find() finds */
+    for (policy.sp_mode = SPLAY_FULL; 
+         policy.sp_mode <= SPLAY_PROB; 
+         ++policy.sp_mode)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            node  = splay_find_policy (&root, splay_NILP, intcomp, 
+                                       &ilist [i], &policy);
+            assert (node != splay_NILP);
+            assert (*(int*)node->splay_item == ilist [i]);
+        }
+    }
+
+    /* Split at 500 and join back; then move [200, 299] out and back */
+    {
+        splay_node_t* lo;
+        splay_node_t* hi;
+        splay_node_t* other = splay_NILP;
+        int           k200  = 200;
+        int           k250  = 250;
+        int           k299  = 299;
+        int           k500  = 500;
+        int           n;
+        int           moved;
+
+        n = splay_check (root, 0, 1000);
+        splay_split (root, splay_NILP, intcomp, &k500, &lo, &hi);
+        assert (splay_check (lo, 0, 500) + splay_check (hi, 500, 1000) == n);
+        root = splay_join (lo, hi, splay_NILP);
+        assert (splay_check (root, 0, 1000) == n);
+
+        assert (splay_move_range (&root, &other, splay_NILP, intcomp, 
+                                  &k200, &k299) == ROK);
+        moved = splay_check (other, 200, 300);
+        assert (splay_check (root, 0, 1000) + moved == n);
+        for (i = 0; i < count; ++i)
+            if ((ilist [i] >= 200) && (ilist [i] <= 299))
+                assert (splay_find (&root, splay_NILP, intcomp, 
+                                    &ilist [i]) == splay_NILP);
+        assert (splay_move_range (&other, &root, splay_NILP, intcomp, 
+                                  &k200, &k299) == ROK);
+        assert (other == splay_NILP);
+        assert (splay_check (root, 0, 1000) == n);
+
+        /* A destination already holding a key in range refuses the move */
+        splay_node_new (&other, (void*) &k250);
+        assert (splay_move_range (&root, &other, splay_NILP, intcomp, 
+                                  &k200, &k299) == RFAIL);
+        assert (splay_check (other, 250, 251) == 1);
+        assert (splay_check (root, 0, 1000) == n);
+        for (i = 0; i < count; ++i)
+            assert (splay_find (&root, splay_NILP, intcomp, 
+                                &ilist [i]) != splay_NILP);
+        splay_node_delete (&other);
+    }
+
     for (i = 0; i < count; ++i)
     {
         node = splay_find (&root, splay_NILP, intcomp, &ilist [i]);
@@ -566,8 +1331,175 @@ int main (int argc, char* argv [])
     }
 
 
+    /* The same keys through the splay heap, some lowered on the way */
+    {
+        splay_heap_t  heap;
+        splay_node_t* hnodes;
+        int           last;
+
+        hnodes = calloc (count, sizeof(*hnodes));
+        splay_heap_init (&heap);
+        for (i = 0; i < count; ++i)
+        {
+            splay_node_init   (&hnodes [i], &ilist [i]);
+            splay_heap_insert (&heap, intcomp, &hnodes [i]);
+        }
+        for (i = 0; i < count; i += 3)
+        {
+            ilist [i] -= rand_r (&seed) % 500;
+            splay_heap_decrease_key (&heap, intcomp, &hnodes [i], &ilist [i]);
+        }
+        for (last = -1000, i = 0; i < count; ++i)
+        {
+            node = splay_heap_delete_min (&heap);
+            assert (node != splay_NILP);
+            assert (*(int*)node->splay_item >= last);
+            last = *(int*)node->splay_item;
+        }
+        assert (splay_heap_min (&heap) == splay_NILP);
+        free (hnodes);
+    }
+
     free (ilist);
     return 0;
 }
 
+#elif defined(EBENCH)
+
+/*
+ * Splay heap against the binomial heap, scheduler style: build, then a
+ * hold phase (delete-min and put the item back later), decrease-keys on
+ * random items, and a final drain. The splay heap reuses its nodes; the
+ * binomial heap allocates on every insert and the caller frees what
+ * extract-min returns, so its hold and drain times include malloc/free.
+ *
+ * cc -O2 -DEBENCH splay-tree.c binomial-heap.c, with base-types.h and
+ * bst-template.h on the include path (neither ships with this tree) and
+ * gperftools' profiler.h for binomial-heap.c.
+ */
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "binomial-heap.h"
+
+#define BENCH_N     100000
+#define BENCH_HOLD  1000000
+#define BENCH_DEC   100000
+
+static int
+bench_comp (void* a, void* b)
+{
+    RETVAL ((*(int*)a > *(int*)b) - (*(int*)a < *(int*)b));
+}
+
+static double
+bench_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    RETVAL (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+#define BENCH_REPORT(what, n, sp, bh)                                        \
+    printf ("%-10s %8.1f %8.1f ns/op\n", (what), (sp) / (n), (bh) / (n))
+
+int main (int argc, char* argv [])
+{
+    static int                   skeys [BENCH_N];
+    static int                   bkeys [BENCH_N];
+    static splay_node_t          snodes [BENCH_N];
+    static binomial_heap_node_t* bnodes [BENCH_N];
+    static uint32_t              pick [BENCH_DEC];
+    static int                   delta [BENCH_HOLD];
+    splay_heap_t                 sheap;
+    binomial_heap_t*             bheap;
+    splay_node_t*                sn;
+    binomial_heap_node_t*        bn;
+    double                       t0, ts, tb;
+    long                         sum = 0;
+    int                          i;
+
+    srand (1);
+    for (i = 0; i < BENCH_N; ++i)
+        skeys [i] = bkeys [i] = rand () % (BENCH_N * 10);
+    for (i = 0; i < BENCH_HOLD; ++i)
+        delta [i] = rand () % 1000;
+    for (i = 0; i < BENCH_DEC; ++i)
+        pick [i] = rand () % BENCH_N;
+
+    printf ("%-10s %8s %8s\n", "", "splay", "binomial");
+
+    t0 = bench_now ();
+    splay_heap_init (&sheap);
+    for (i = 0; i < BENCH_N; ++i)
+    {
+        splay_node_init   (&snodes [i], &skeys [i]);
+        splay_heap_insert (&sheap, bench_comp, &snodes [i]);
+    }
+    ts = bench_now () - t0;
+    t0 = bench_now ();
+    binomial_heap_new (&bheap);
+    for (i = 0; i < BENCH_N; ++i)
+        bnodes [i] = binomial_heap_insert (&bheap, &bkeys [i], bench_comp);
+    tb = bench_now () - t0;
+    BENCH_REPORT ("insert", BENCH_N, ts, tb);
+
+    /* Keys move between binomial nodes, so lower whatever a node holds */
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_DEC; ++i)
+    {
+        sn = &snodes [pick [i]];
+        *(int*)sn->splay_item -= 1 + i % 100;
+        splay_heap_decrease_key (&sheap, bench_comp, sn, sn->splay_item);
+    }
+    ts = bench_now () - t0;
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_DEC; ++i)
+    {
+        bn = bnodes [pick [i]];
+        *(int*)bn->bn_key -= 1 + i % 100;
+        binomial_heap_decrease_key (bheap, bn, bn->bn_key, bench_comp);
+    }
+    tb = bench_now () - t0;
+    BENCH_REPORT ("decrease", BENCH_DEC, ts, tb);
+
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_HOLD; ++i)
+    {
+        sn = splay_heap_delete_min (&sheap);
+        *(int*)sn->splay_item += delta [i];
+        splay_heap_insert (&sheap, bench_comp, sn);
+    }
+    ts = bench_now () - t0;
+    t0 = bench_now ();
+    for (i = 0; i < BENCH_HOLD; ++i)
+    {
+        bn = binomial_heap_extract_min (&bheap, bench_comp);
+        *(int*)bn->bn_key += delta [i];
+        binomial_heap_insert (&bheap, bn->bn_key, bench_comp);
+        free (bn);
+    }
+    tb = bench_now () - t0;
+    BENCH_REPORT ("hold", BENCH_HOLD, ts, tb);
+
+    t0 = bench_now ();
+    while ((sn = splay_heap_delete_min (&sheap)) != splay_NILP)
+        sum += *(int*)sn->splay_item;
+    ts = bench_now () - t0;
+    t0 = bench_now ();
+    while (bheap->bh_count && 
+           (bn = binomial_heap_extract_min (&bheap, bench_comp)) != NULL)
+    {
+        sum -= *(int*)bn->bn_key;
+        free (bn);
+    }
+    tb = bench_now () - t0;
+    BENCH_REPORT ("drain", BENCH_N, ts, tb);
+
+    binomial_heap_destroy (&bheap, true);
+    RETVAL (sum != 0);
+}
+
 #endif
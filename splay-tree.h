@@ -26,6 +26,60 @@ DEFINE_TEMPLATE_BST_COMPARATOR(splay)
 
 DEFIME_TEMPLATE_BST_STRUCT(splay)
 
+/*
+ * How a lookup through splay_find_policy() restructures the tree:
+ *
+ * SPLAY_FULL   Splay the node to the root, like splay_find().
+ * SPLAY_SEMI   Semi-splay: each zig-zig step rotates only the upper edge
+ *              and carries on from the parent, so the path is roughly
+ *              halved with about half the rotations (and pointer writes)
+ *              of a full splay; the node need not end up at the root.
+ * SPLAY_DEPTH  Search without writing, and splay fully only when the node
+ *              is found deeper than sp_depth (c * log2 n, say). The tree
+ *              keeps no node count, so the caller tracks n and refreshes
+ *              sp_depth as the tree grows or shrinks; a stale threshold
+ *              only makes splays too frequent or too rare.
+ * SPLAY_PROB   Search without writing, and splay fully only on a random
+ *              sp_prob / 65536 of the hits.
+ *
+ * A lookup that does not splay writes nothing to the tree, but under
+ * SPLAY_DEPTH and SPLAY_PROB any hit may splay and rotate the tree under
+ * other readers, so concurrent lookups still need a lock. They can only
+ * go without one when none of them can splay: sp_depth no lower than the
+ * tree's height, or sp_prob of 0 with a policy per thread (sp_seed is
+ * still updated).
+ */
+typedef enum
+{
+    SPLAY_FULL,
+    SPLAY_SEMI,
+    SPLAY_DEPTH,
+    SPLAY_PROB
+} splay_mode_t;
+
+typedef struct splay_policy_
+{
+    splay_mode_t sp_mode;
+    uint32_t     sp_depth;        /* SPLAY_DEPTH: splay below this depth  */
+    uint32_t     sp_prob;         /* SPLAY_PROB: in 1/65536ths            */
+    uint32_t     sp_seed;         /* SPLAY_PROB: random state, nonzero    */
+} splay_policy_t;
+
+/*
+ * Splay heap (Okasaki): a priority queue kept as a search tree. Insert
+ * partitions the tree around the new key, which becomes the root; the
+ * minimum is cached, and the heap keeps splay_parent current so that
+ * delete-min and decrease-key start right at the node. Unlike the splay
+ * tree, equal keys are fine; ties come out in insertion order. A node
+ * is in a heap or in a splay tree, never both.
+ */
+typedef struct splay_heap_
+{
+    splay_node_t* sh_root;
+    splay_node_t* sh_min;         /* leftmost node; NIL when empty       */
+    uint32_t      sh_count;
+} splay_heap_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -60,6 +114,36 @@ extern splay_node_t* splay_find         (splay_node_t**     splay_rootp,
                                          splay_comparator_t splay_comp,
                                          void*              item);
 
+extern splay_node_t* splay_find_policy  (splay_node_t**     splay_rootp, 
+                                         splay_node_t*      nilp, 
+                                         splay_comparator_t splay_comp,
+                                         void*              item,
+                                         splay_policy_t*    policy);
+
+extern void          splay_split        (splay_node_t*      splay_root,
+                                         splay_node_t*      nilp, 
+                                         splay_comparator_t splay_comp,
+                                         void*              key,
+                                         splay_node_t**     lop,
+                                         splay_node_t**     hip);
+
+extern splay_node_t* splay_join         (splay_node_t*      lo,
+                                         splay_node_t*      hi,
+                                         splay_node_t*      nilp);
+
+extern splay_node_t* splay_remove_range (splay_node_t**     splay_rootp, 
+                                         splay_node_t*      nilp, 
+                                         splay_comparator_t splay_comp,
+                                         void*              lo,
+                                         void*              hi);
+
+extern rc_t          splay_move_range   (splay_node_t**     srcp, 
+                                         splay_node_t**     dstp, 
+                                         splay_node_t*      nilp, 
+                                         splay_comparator_t splay_comp,
+                                         void*              lo,
+                                         void*              hi);
+
 extern splay_node_t* splay_delete_min   (splay_node_t**     splay_rootp, 
                                          splay_node_t*      nilp, 
                                          splay_comparator_t splay_comp);
@@ -69,6 +153,23 @@ extern splay_node_t* splay_decrease_key (splay_node_t**     splay_rootp,
                                          splay_comparator_t splay_comp,
                                          splay_node_t*      node,
                                          void*              newkey);
+
+extern void          splay_heap_init    (splay_heap_t*      heap);
+
+extern void          splay_heap_insert  (splay_heap_t*      heap,
+                                         splay_comparator_t splay_comp,
+                                         splay_node_t*      node);
+
+extern splay_node_t* splay_heap_min     (splay_heap_t*      heap);
+
+extern splay_node_t* splay_heap_delete_min 
+                                        (splay_heap_t*      heap);
+
+extern void          splay_heap_decrease_key 
+                                        (splay_heap_t*      heap,
+                                         splay_comparator_t splay_comp,
+                                         splay_node_t*      node,
+                                         void*              newkey);
 #ifdef __cplusplus
 }
 #endif